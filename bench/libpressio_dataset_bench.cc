@@ -0,0 +1,401 @@
+/**
+ * microbenchmarks for the dataset loader plugins
+ *
+ * each benchmark generates its input files once in a scratch directory
+ * (LIBPRESSIO_DATASET_BENCH_DIR, or a directory under the system temporary
+ * directory) that is removed when the process exits.  Reported times are per
+ * call, so they are the latency of one load, and bytes_per_second and
+ * items_per_second are the throughput.
+ *
+ * to record results for comparison between releases:
+ *
+ *   libpressio_dataset_bench --benchmark_out=results.json --benchmark_out_format=json
+ *
+ * or build the run_libpressio_dataset_bench target.  --benchmark_filter=<regex>
+ * selects a subset, i.e. --benchmark_filter=block_ to run only the samplers.
+ */
+#include <benchmark/benchmark.h>
+#include <libpressio_dataset_ext/loader.h>
+#include <libpressio_ext/cpp/libpressio.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#if LIBPRESSIO_DATASET_HAS_HDF5
+#include <hdf5.h>
+#endif
+
+using namespace std::string_literals;
+using namespace libpressio_dataset;
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * the generated input files, created on first use and shared by every benchmark
+ */
+class bench_files {
+  public:
+    static bench_files& get() {
+      static bench_files files;
+      return files;
+    }
+    bench_files(bench_files const&)=delete;
+    bench_files& operator=(bench_files const&)=delete;
+    ~bench_files() {
+      std::error_code ec;
+      if(owned) fs::remove_all(root, ec);
+    }
+
+    /**
+     * \returns a directory of n raw files, f0000.raw, f0001.raw, ..., each of the given dtype and dims
+     */
+    fs::path folder(size_t n, pressio_dtype dtype, std::vector<size_t> const& dims) {
+      const fs::path dir = root / ("folder_" + std::to_string(n) + "_" + describe(dtype, dims));
+      if(!fs::exists(dir / "done")) {
+        fs::create_directories(dir);
+        for (size_t i = 0; i < n; ++i) {
+          char name[32];
+          std::snprintf(name, sizeof(name), "f%04zu.raw", i);
+          write_raw(dir / name, dtype, dims, i);
+        }
+        std::ofstream(dir / "done");
+      }
+      return dir;
+    }
+
+    /**
+     * \returns a single raw file of the given dtype and dims
+     */
+    fs::path raw(pressio_dtype dtype, std::vector<size_t> const& dims) {
+      return folder(1, dtype, dims) / "f0000.raw";
+    }
+
+#if LIBPRESSIO_DATASET_HAS_HDF5
+    /**
+     * \returns an HDF5 file of n datasets, d0000, d0001, ..., each of the given dtype and dims
+     *
+     * \param[in] chunked if true, store the datasets in chunks of up to 64 elements along each dimension
+     */
+    fs::path hdf5(size_t n, pressio_dtype dtype, std::vector<size_t> const& dims, bool chunked) {
+      const fs::path path = root / ("hdf5_" + std::to_string(n) + "_" + describe(dtype, dims) + (chunked ? "_chunked" : "") + ".h5");
+      if(fs::exists(path)) return path;
+
+      const hid_t type = (dtype == pressio_double_dtype) ? H5T_NATIVE_DOUBLE : H5T_NATIVE_FLOAT;
+      std::vector<hsize_t> h5dims(dims.rbegin(), dims.rend());
+      std::vector<hsize_t> chunks;
+      for (auto d : h5dims) chunks.push_back(std::min<hsize_t>(d, 64));
+      hid_t file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+      hid_t space = H5Screate_simple(static_cast<int>(h5dims.size()), h5dims.data(), nullptr);
+      hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+      if(chunked) H5Pset_chunk(dcpl, static_cast<int>(chunks.size()), chunks.data());
+      for (size_t i = 0; i < n; ++i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "d%04zu", i);
+        pressio_data values = generate(dtype, dims, i);
+        hid_t dset = H5Dcreate2(file, name, type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data());
+        H5Dclose(dset);
+      }
+      H5Pclose(dcpl);
+      H5Sclose(space);
+      H5Fclose(file);
+      return path;
+    }
+#endif
+
+  private:
+    bench_files() {
+      if(const char* dir = std::getenv("LIBPRESSIO_DATASET_BENCH_DIR")) {
+        root = dir;
+      } else {
+        root = fs::temp_directory_path() / ("libpressio_dataset_bench." + std::to_string(getpid()));
+        owned = true;
+      }
+      fs::create_directories(root);
+    }
+
+    static std::string describe(pressio_dtype dtype, std::vector<size_t> const& dims) {
+      std::ostringstream ss;
+      ss << (dtype == pressio_double_dtype ? "f64" : "f32");
+      for (auto d : dims) ss << '_' << d;
+      return ss.str();
+    }
+
+    static pressio_data generate(pressio_dtype dtype, std::vector<size_t> const& dims, size_t seed) {
+      pressio_data values = pressio_data::owning(dtype, dims);
+      std::minstd_rand gen(static_cast<std::minstd_rand::result_type>(seed + 1));
+      std::uniform_real_distribution<double> dist(-1, 1);
+      if(dtype == pressio_double_dtype) {
+        auto ptr = static_cast<double*>(values.data());
+        for (size_t i = 0; i < values.num_elements(); ++i) ptr[i] = dist(gen);
+      } else {
+        auto ptr = static_cast<float*>(values.data());
+        for (size_t i = 0; i < values.num_elements(); ++i) ptr[i] = static_cast<float>(dist(gen));
+      }
+      return values;
+    }
+
+    static void write_raw(fs::path const& path, pressio_dtype dtype, std::vector<size_t> const& dims, size_t seed) {
+      pressio_data values = generate(dtype, dims, seed);
+      std::ofstream out(path, std::ios::binary);
+      out.write(static_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size_in_bytes()));
+    }
+
+    fs::path root;
+    bool owned = false;
+};
+
+pressio_dtype dtype_arg(int64_t arg) {
+  return arg ? pressio_double_dtype : pressio_float_dtype;
+}
+
+std::vector<size_t> dims_arg(int64_t ndims, int64_t edge) {
+  return std::vector<size_t>(static_cast<size_t>(ndims), static_cast<size_t>(edge));
+}
+
+/**
+ * options that read the raw files made by bench_files with io_loader
+ */
+pressio_options raw_options(pressio_dtype dtype, std::vector<size_t> const& dims) {
+  return {
+    {"io_loader:dims", pressio_data(dims.begin(), dims.end())},
+    {"io_loader:dtype", dtype},
+    {"io_loader:use_template", true},
+    {"io_loader:plugin", "posix"s},
+  };
+}
+
+pressio_options folder_options(fs::path const& dir, pressio_dtype dtype, std::vector<size_t> const& dims) {
+  pressio_options options = raw_options(dtype, dims);
+  options.set("folder:base_dir", dir.string());
+  options.set("folder:regex", "(?:[^/]*/)+f\\d+\\.raw"s);
+  return options;
+}
+
+/**
+ * build and configure a loader, or report why it could not be on state
+ */
+pressio_dataset_loader make_loader(benchmark::State& state, std::string const& id, pressio_options const& options) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build(id);
+  if(!loader) {
+    state.SkipWithError(("unable to build " + id).c_str());
+    return loader;
+  }
+  if(loader->set_options(options)) {
+    state.SkipWithError(loader->error_msg());
+    return pressio_dataset_loader{};
+  }
+  if(loader->num_datasets() == 0) {
+    state.SkipWithError((id + " found no datasets").c_str());
+    return pressio_dataset_loader{};
+  }
+  return loader;
+}
+
+/**
+ * load every dataset of loader in turn, one per iteration
+ */
+void load_each(benchmark::State& state, dataset_loader& loader) {
+  const size_t n = loader.num_datasets();
+  size_t i = 0;
+  uint64_t bytes = 0;
+  for (auto _ : state) {
+    pressio_data data = loader.load_data(i);
+    benchmark::DoNotOptimize(data.data());
+    bytes += data.size_in_bytes();
+    if(++i == n) i = 0;
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+  state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * sizes of 2d and 3d datasets from 16 KiB to 8 MiB of floats
+ */
+void dims_and_dtypes(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"ndims", "edge", "double"});
+  for (int64_t dtype : {0, 1}) {
+    for (int64_t edge : {64, 256, 1024}) b->Args({2, edge, dtype});
+    for (int64_t edge : {16, 64, 128}) b->Args({3, edge, dtype});
+  }
+}
+
+void io_loader(benchmark::State& state) {
+  const auto dtype = dtype_arg(state.range(2));
+  const auto dims = dims_arg(state.range(0), state.range(1));
+  pressio_options options = raw_options(dtype, dims);
+  options.set("io:path", bench_files::get().raw(dtype, dims).string());
+  auto loader = make_loader(state, "io_loader", options);
+  if(!loader) return;
+  load_each(state, *loader);
+}
+BENCHMARK(io_loader)->Apply(dims_and_dtypes)->UseRealTime();
+
+void folder_load(benchmark::State& state) {
+  const auto dtype = dtype_arg(state.range(2));
+  const auto dims = dims_arg(state.range(0), state.range(1));
+  pressio_options options = folder_options(bench_files::get().folder(16, dtype, dims), dtype, dims);
+  options.set("folder:io_mode", state.range(3) ? "async"s : "loader"s);
+  auto loader = make_loader(state, "folder", options);
+  if(!loader) return;
+  state.SetLabel(state.range(3) ? "async" : "loader");
+  load_each(state, *loader);
+}
+BENCHMARK(folder_load)
+  ->ArgNames({"ndims", "edge", "double", "async"})
+  ->ArgsProduct({{2}, {64, 256, 1024}, {0, 1}, {0, 1}})
+  ->ArgsProduct({{3}, {16, 64, 128}, {0, 1}, {0, 1}})
+  ->UseRealTime();
+
+void folder_scan(benchmark::State& state) {
+  const size_t files = static_cast<size_t>(state.range(0));
+  const std::vector<size_t> dims{16, 16};
+  pressio_options options = folder_options(bench_files::get().folder(files, pressio_float_dtype, dims), pressio_float_dtype, dims);
+  options.set("folder:scan_threads", static_cast<uint64_t>(state.range(1)));
+  auto loader = make_loader(state, "folder", options);
+  if(!loader) return;
+  for (auto _ : state) {
+    loader->set_options({{"folder:rescan", true}});
+    benchmark::DoNotOptimize(loader->num_datasets());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(folder_scan)
+  ->ArgNames({"files", "scan_threads"})
+  ->ArgsProduct({{64, 1024}, {1, 4}})
+  ->UseRealTime();
+
+#if LIBPRESSIO_DATASET_HAS_HDF5
+void hdf5_datasets(benchmark::State& state) {
+  const auto dtype = dtype_arg(state.range(2));
+  const auto dims = dims_arg(state.range(0), state.range(1));
+  const bool chunked = state.range(3);
+  pressio_options options{
+    {"io:path", bench_files::get().hdf5(16, dtype, dims, chunked).string()},
+    {"hdf5_datasets:decode_threads", static_cast<uint64_t>(state.range(4))},
+  };
+  auto loader = make_loader(state, "hdf5_datasets", options);
+  if(!loader) return;
+  load_each(state, *loader);
+}
+BENCHMARK(hdf5_datasets)
+  ->ArgNames({"ndims", "edge", "double", "chunked", "decode_threads"})
+  ->ArgsProduct({{2}, {64, 256, 1024}, {0, 1}, {0, 1}, {1}})
+  ->ArgsProduct({{3}, {16, 64, 128}, {0, 1}, {0, 1}, {1}})
+  ->ArgsProduct({{2}, {1024}, {0}, {1}, {4}})
+  ->UseRealTime();
+#endif
+
+/**
+ * a 1024x1024 or 128^3 field of floats cut into blocks of the given edge
+ */
+void blocks(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"ndims", "block"});
+  for (int64_t block : {16, 64, 256}) b->Args({2, block});
+  for (int64_t block : {8, 32, 64}) b->Args({3, block});
+}
+
+std::vector<size_t> block_field(int64_t ndims) {
+  return ndims == 2 ? std::vector<size_t>{1024, 1024} : std::vector<size_t>{128, 128, 128};
+}
+
+void block_slicer(benchmark::State& state) {
+  const auto dims = block_field(state.range(0));
+  const auto block = dims_arg(state.range(0), state.range(1));
+  pressio_options options = raw_options(pressio_float_dtype, dims);
+  options.set("io:path", bench_files::get().raw(pressio_float_dtype, dims).string());
+  options.set("block_slicer:loader", "io_loader"s);
+  options.set("block_slicer:block_size", pressio_data(block.begin(), block.end()));
+  auto loader = make_loader(state, "block_slicer", options);
+  if(!loader) return;
+  load_each(state, *loader);
+}
+BENCHMARK(block_slicer)->Apply(blocks)->UseRealTime();
+
+void block_sampler(benchmark::State& state) {
+  const auto dims = block_field(state.range(0));
+  const auto block = dims_arg(state.range(0), state.range(1));
+  pressio_options options = raw_options(pressio_float_dtype, dims);
+  options.set("io:path", bench_files::get().raw(pressio_float_dtype, dims).string());
+  options.set("block_sampler:loader", "io_loader"s);
+  options.set("block_sampler:block_size", pressio_data(block.begin(), block.end()));
+  options.set("block_sampler:n", uint64_t{64});
+  auto loader = make_loader(state, "block_sampler", options);
+  if(!loader) return;
+  load_each(state, *loader);
+}
+BENCHMARK(block_sampler)->Apply(blocks)->UseRealTime();
+
+void random_sampler(benchmark::State& state) {
+  const std::vector<size_t> dims{256, 256};
+  const char* order = state.range(0) ? "index" : "random";
+  pressio_options options = folder_options(bench_files::get().folder(64, pressio_float_dtype, dims), pressio_float_dtype, dims);
+  options.set("random_sampler:loader", "folder"s);
+  options.set("random_sampler:n", uint64_t{256});
+  options.set("random_sampler:order", std::string(order));
+  auto loader = make_loader(state, "random_sampler", options);
+  if(!loader) return;
+  state.SetLabel(order);
+  load_each(state, *loader);
+}
+BENCHMARK(random_sampler)->ArgNames({"index_order"})->Arg(0)->Arg(1)->UseRealTime();
+
+void synthetic(benchmark::State& state) {
+  static const char* fields[] = {"gaussian", "sinusoid", "turbulence", "constant", "sparse"};
+  const char* field = fields[state.range(0)];
+  pressio_options options{
+    {"synthetic:dims", pressio_data{1024, 1024}},
+    {"synthetic:n", uint64_t{1} << 20},
+    {"synthetic:field", std::string(field)},
+    {"synthetic:nthreads", static_cast<uint64_t>(state.range(1))},
+  };
+  auto loader = make_loader(state, "synthetic", options);
+  if(!loader) return;
+  state.SetLabel(field);
+  load_each(state, *loader);
+}
+BENCHMARK(synthetic)
+  ->ArgNames({"field", "nthreads"})
+  ->ArgsProduct({{0, 1, 2, 3, 4}, {1, 4}})
+  ->UseRealTime();
+
+/**
+ * cycles through 32 files with the cache holding all or half of them; with
+ * half, the cyclic scan defeats the policies, so it measures the cost of a
+ * miss plus an eviction
+ */
+void cache(benchmark::State& state) {
+  static const char* policies[] = {"lru", "lfu", "arc"};
+  const char* policy = policies[state.range(0)];
+  const std::vector<size_t> dims{256, 256};
+  const uint64_t working_set = 32 * 256 * 256 * sizeof(float);
+  pressio_options options = folder_options(bench_files::get().folder(32, pressio_float_dtype, dims), pressio_float_dtype, dims);
+  options.set("cache:loader", "folder"s);
+  options.set("cache:policy", std::string(policy));
+  options.set("cache:max_bytes", working_set * static_cast<uint64_t>(state.range(1)) / 100);
+  auto loader = make_loader(state, "cache", options);
+  if(!loader) return;
+  for (size_t i = 0; i < loader->num_datasets(); ++i) {
+    loader->load_data(i);
+  }
+  uint64_t hits_before = 0;
+  loader->get_options().get("cache:hits", &hits_before);
+  state.SetLabel(policy);
+  load_each(state, *loader);
+  uint64_t hits = 0;
+  loader->get_options().get("cache:hits", &hits);
+  state.counters["hit_rate"] = static_cast<double>(hits - hits_before) / static_cast<double>(state.iterations());
+}
+BENCHMARK(cache)
+  ->ArgNames({"policy", "capacity_pct"})
+  ->ArgsProduct({{0, 1, 2}, {100, 50}})
+  ->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
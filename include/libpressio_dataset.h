@@ -11,6 +11,8 @@ extern "C" {
 struct pressio_data;
 struct pressio_options;
 struct pressio_dataset_loader;
+struct pressio_dataset_loader_cursor;
+struct pressio_dataset_loader_request;
 struct pressio;
 
 /**
@@ -151,14 +153,134 @@ const char* pressio_dataset_loader_error_msg(struct pressio_dataset_loader* data
 
 int pressio_datset_loader_num_datasets(struct pressio_dataset_loader* dataset_loader, size_t* n);
 
+/**
+ * load the metadata for every dataset
+ *
+ * if loader:nthreads is greater than 1, the datasets are loaded in parallel
+ *
+ * \param[in] dataset_loader the loader to use
+ * \param[out] n the number of datasets loaded
+ * \param[out] metadata a newly allocated array of n metadata entries
+ * \returns 0 on success, >0 on error
+ */
 int pressio_dataset_loader_load_all_metadata(struct pressio_dataset_loader* dataset_loader, size_t* n, struct pressio_options***);
 
+/**
+ * load every dataset
+ *
+ * if loader:nthreads is greater than 1, the datasets are loaded in parallel
+ *
+ * \param[in] dataset_loader the loader to use
+ * \param[out] n the number of datasets loaded
+ * \param[out] data a newly allocated array of n datasets
+ * \returns 0 on success, >0 on error
+ */
 int pressio_dataset_loader_load_all_data(struct pressio_dataset_loader* dataset_loader, size_t* n, struct pressio_data***);
 
 int pressio_dataset_loader_load_metadata(struct pressio_dataset_loader* dataset_loader, size_t n, struct pressio_options**);
 
 int pressio_dataset_loader_load_data(struct pressio_dataset_loader* dataset_loader, size_t n, struct pressio_data**);
 
+/**
+ * load several datasets at once
+ *
+ * \param[in] dataset_loader the loader to use
+ * \param[in] n_indices the number of datasets to load
+ * \param[in] indices the datasets to load
+ * \param[out] data a newly allocated array of n_indices datasets in the same order as indices
+ * \returns 0 on success, >0 on error
+ */
+int pressio_dataset_loader_load_data_batch(struct pressio_dataset_loader* dataset_loader, size_t n_indices, size_t const* indices, struct pressio_data*** data);
+
+/**
+ * load the metadata for several datasets at once
+ *
+ * \param[in] dataset_loader the loader to use
+ * \param[in] n_indices the number of datasets to load metadata for
+ * \param[in] indices the datasets to load metadata for
+ * \param[out] metadata a newly allocated array of n_indices metadata entries in the same order as indices
+ * \returns 0 on success, >0 on error
+ */
+int pressio_dataset_loader_load_metadata_batch(struct pressio_dataset_loader* dataset_loader, size_t n_indices, size_t const* indices, struct pressio_options*** metadata);
+
+/**
+ * start streaming datasets from a loader in order
+ *
+ * a background thread loads up to depth datasets ahead of calls to
+ * pressio_dataset_loader_cursor_next.  The loader must outlive the cursor and
+ * may not be reconfigured while the cursor is in use.
+ *
+ * \param[in] dataset_loader the loader to read from
+ * \param[in] n_indices the number of datasets to read
+ * \param[in] indices the datasets to read in the order they are produced; if NULL, every dataset is read
+ * \param[in] depth the number of datasets loaded ahead of the consumer
+ * \returns the new cursor, or NULL on error with the error set on dataset_loader
+ */
+struct pressio_dataset_loader_cursor* pressio_dataset_loader_cursor_new(struct pressio_dataset_loader* dataset_loader, size_t n_indices, size_t const* indices, size_t depth);
+
+/**
+ * wait for the next dataset from a cursor
+ *
+ * \param[in] cursor the cursor to read from
+ * \param[out] index the index of the dataset in the loader
+ * \param[out] data a newly allocated copy of the dataset
+ * \param[out] metadata newly allocated metadata for the dataset
+ * \returns 0 on success, -1 once every dataset has been read, >0 on error with the error set on the cursor's loader
+ */
+int pressio_dataset_loader_cursor_next(struct pressio_dataset_loader_cursor* cursor, size_t* index, struct pressio_data** data, struct pressio_options** metadata);
+
+/**
+ * stop a cursor and free it, discarding datasets that have not been read
+ */
+void pressio_dataset_loader_cursor_free(struct pressio_dataset_loader_cursor* cursor);
+
+/**
+ * get the counters for the calls made to a loader and the loaders it uses
+ *
+ * \param[in] dataset_loader the loader to query
+ * \returns the counters for each loader keyed by its name, i.e. /name:metrics:load_data:calls
+ */
+struct pressio_options* pressio_dataset_loader_get_metrics_results(struct pressio_dataset_loader const* dataset_loader);
+
+/**
+ * called when a load from pressio_dataset_loader_load_data_async finishes or is cancelled
+ *
+ * \param[in] n the index that was loaded
+ * \param[in] status 0 on success, -1 if the load was cancelled, >0 on error
+ * \param[in] data on success, the dataset, which the callback must free; otherwise NULL
+ * \param[in] error_msg on error, a message that is valid until the callback returns; otherwise NULL
+ * \param[in] user_data the user_data passed to pressio_dataset_loader_load_data_async
+ */
+typedef void (*pressio_dataset_loader_load_callback)(size_t n, int status, struct pressio_data* data, const char* error_msg, void* user_data);
+
+/**
+ * load a dataset on a thread managed by the library
+ *
+ * the callback is called from the thread that finishes the load, or from the
+ * thread that cancels it.  The loader must outlive the load and may not be
+ * reconfigured until the callback has been called.
+ *
+ * \param[in] dataset_loader the loader to use
+ * \param[in] n the dataset to load
+ * \param[in] callback called exactly once when the load finishes or is cancelled
+ * \param[in] user_data passed to the callback
+ * \returns a request to cancel the load which must be freed with pressio_dataset_loader_request_free
+ */
+struct pressio_dataset_loader_request* pressio_dataset_loader_load_data_async(struct pressio_dataset_loader* dataset_loader, size_t n, pressio_dataset_loader_load_callback callback, void* user_data);
+
+/**
+ * cancel a load if it has not started
+ *
+ * \param[in] request the load to cancel
+ * \returns 0 if the load was cancelled and its callback was called with status -1, 1 if the load had already started
+ */
+int pressio_dataset_loader_request_cancel(struct pressio_dataset_loader_request* request);
+
+/**
+ * free a request; this does not cancel the load
+ */
+void pressio_dataset_loader_request_free(struct pressio_dataset_loader_request* request);
+
 /*!
  * \returns the major version number of the library
  */
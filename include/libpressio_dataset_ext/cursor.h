@@ -0,0 +1,129 @@
+#ifndef LIBPRESSIO_DATASET_CURSOR_H_N5QW8HJD
+#define LIBPRESSIO_DATASET_CURSOR_H_N5QW8HJD
+#include <libpressio_dataset_ext/loader.h>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace libpressio_dataset {
+
+/**
+ * a dataset produced by a dataset_cursor
+ */
+struct cursor_item {
+  /** the index of the dataset in the loader */
+  size_t index = 0;
+  pressio_data data;
+  pressio_options metadata;
+};
+
+/**
+ * streams datasets from a loader in order
+ *
+ * a producer thread loads the data and metadata of each index ahead of the
+ * consumer into a bounded ring, so reads overlap with the consumer's work while
+ * at most depth datasets are held at once.
+ *
+ * the cursor calls the loader from its producer thread, so the loader must
+ * outlive the cursor and may not be reconfigured while it is in use.  The
+ * cursor itself is consumed from a single thread.
+ */
+class dataset_cursor {
+  public:
+    /**
+     * stream every dataset of loader
+     *
+     * \param[in] loader the loader to read from
+     * \param[in] depth the number of datasets loaded ahead of the consumer
+     */
+    explicit dataset_cursor(dataset_loader& loader, size_t depth = 2);
+
+    /**
+     * stream the datasets of loader at indices
+     *
+     * \param[in] loader the loader to read from
+     * \param[in] indices the datasets to read, in the order they are produced
+     * \param[in] depth the number of datasets loaded ahead of the consumer
+     */
+    dataset_cursor(dataset_loader& loader, std::vector<size_t> indices, size_t depth = 2);
+    dataset_cursor(dataset_cursor const&)=delete;
+    dataset_cursor& operator=(dataset_cursor const&)=delete;
+
+    /**
+     * stops the producer, discarding datasets that have not been consumed
+     */
+    ~dataset_cursor();
+
+    /**
+     * wait for the next dataset
+     *
+     * \param[out] item the next dataset
+     * \returns false once every dataset has been produced
+     * \throws the exception thrown by the loader for the next dataset; the cursor stops afterwards
+     */
+    bool next(cursor_item& item);
+
+    class iterator {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = cursor_item;
+        using difference_type = std::ptrdiff_t;
+        using pointer = cursor_item*;
+        using reference = cursor_item&;
+
+        iterator()=default;
+        explicit iterator(dataset_cursor* cursor): cursor(cursor) {
+          ++*this;
+        }
+        reference operator*() {
+          return item;
+        }
+        pointer operator->() {
+          return &item;
+        }
+        iterator& operator++() {
+          if(cursor && !cursor->next(item)) {
+            cursor = nullptr;
+          }
+          return *this;
+        }
+        bool operator==(iterator const& rhs) const {
+          return cursor == rhs.cursor;
+        }
+        bool operator!=(iterator const& rhs) const {
+          return cursor != rhs.cursor;
+        }
+
+      private:
+        dataset_cursor* cursor = nullptr;
+        cursor_item item;
+    };
+
+    /**
+     * \returns an iterator over the remaining datasets; the cursor can only be iterated once
+     */
+    iterator begin() {
+      return iterator(this);
+    }
+    iterator end() {
+      return iterator();
+    }
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> state;
+};
+
+/**
+ * the C handle for a dataset_cursor, which remembers its loader to report errors on
+ */
+struct pressio_dataset_loader_cursor {
+  pressio_dataset_loader_cursor(pressio_dataset_loader* loader, std::vector<size_t> indices, size_t depth):
+    loader(loader), cursor(**loader, std::move(indices), depth) {}
+  pressio_dataset_loader* loader;
+  dataset_cursor cursor;
+};
+
+}
+
+#endif /* end of include guard: LIBPRESSIO_DATASET_CURSOR_H_N5QW8HJD */
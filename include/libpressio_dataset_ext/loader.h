@@ -4,8 +4,67 @@
 #include <libpressio_ext/cpp/errorable.h>
 #include <libpressio_ext/cpp/versionable.h>
 #include <libpressio_ext/cpp/pressio.h>
+#include <libpressio_dataset_ext/metrics.h>
+#include <libpressio_dataset_ext/trace.h>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
 
 namespace libpressio_dataset {
+
+/**
+ * reported by the future of a load that was cancelled before it started
+ */
+class load_cancelled: public std::runtime_error {
+  public:
+  load_cancelled(): std::runtime_error("load cancelled") {}
+};
+
+/**
+ * a load scheduled by dataset_loader::load_data_async
+ */
+class async_load {
+  public:
+  struct state;
+  async_load()=default;
+  async_load(std::shared_ptr<state> load, std::future<pressio_data>&& future): future(std::move(future)), load(std::move(load)) {}
+
+  /**
+   * cancel the load if it has not started
+   *
+   * \returns true if the load was cancelled; its future then throws load_cancelled.
+   * false if it had already started, which it then finishes normally
+   */
+  bool cancel();
+
+  /**
+   * wait for the load
+   *
+   * \returns the dataset
+   * \throws load_cancelled if the load was cancelled, or the exception thrown by the loader
+   */
+  pressio_data get() {
+    return future.get();
+  }
+
+  /** the result of the load; invalid if the load was given a callback */
+  std::future<pressio_data> future;
+
+  private:
+  std::shared_ptr<state> load;
+};
+
+/**
+ * a source of datasets
+ *
+ * concurrency: once configured, num_datasets, load_data, load_metadata,
+ * load_region, supports_region, the batch and load_all methods, and clone may
+ * be called on the same loader from several threads at once.  Loaders build
+ * their indices once on first use and keep any per-call state of their children
+ * per call.  set_options and set_name reconfigure the loader, and may not be
+ * called concurrently with any other method.
+ */
 class dataset_loader: public pressio_configurable, public pressio_versionable {
   public:
   std::string type() const final {
@@ -15,45 +74,161 @@ class dataset_loader: public pressio_configurable, public pressio_versionable {
   virtual pressio_data load_data(size_t)=0;
   virtual pressio_options load_metadata(size_t)=0;
 
-  virtual std::vector<pressio_options> load_all_metadata() {
-    std::vector<pressio_options> ret;
-    size_t N = num_datasets();
-    for (size_t i = 0; i < N; ++i) {
-      ret.emplace_back(load_metadata(i));
+  /**
+   * load the metadata for every dataset
+   *
+   * when loader:nthreads is greater than 1, the indices are divided among
+   * that many threads each using its own clone() of this loader
+   */
+  virtual std::vector<pressio_options> load_all_metadata();
+
+  /**
+   * load every dataset
+   *
+   * when loader:nthreads is greater than 1, the indices are divided among
+   * that many threads each using its own clone() of this loader
+   */
+  virtual std::vector<pressio_data> load_all_data();
+
+  /**
+   * load several datasets at once
+   *
+   * loaders may override this to share work between the requested indices
+   * (i.e. opening a file once, or loading a parent dataset once)
+   *
+   * \param[in] indices the datasets to load
+   * \returns the datasets in the same order as indices
+   */
+  virtual std::vector<pressio_data> load_data_batch(std::vector<size_t> const& indices) {
+    std::vector<pressio_data> ret;
+    ret.reserve(indices.size());
+    for (auto i : indices) {
+      ret.emplace_back(load_data(i));
     }
     return ret;
   }
 
-  virtual std::vector<pressio_data> load_all_data() {
-    std::vector<pressio_data> ret;
-    size_t N = num_datasets();
-    for (size_t i = 0; i < N; ++i) {
-      ret.emplace_back(load_data(i));
+  /**
+   * load the metadata for several datasets at once
+   *
+   * \param[in] indices the datasets to load metadata for
+   * \returns the metadata in the same order as indices
+   */
+  virtual std::vector<pressio_options> load_metadata_batch(std::vector<size_t> const& indices) {
+    std::vector<pressio_options> ret;
+    ret.reserve(indices.size());
+    for (auto i : indices) {
+      ret.emplace_back(load_metadata(i));
     }
     return ret;
   }
 
+  /**
+   * \returns true if load_region reads only the requested region instead of
+   * loading the whole dataset and copying the region out of it
+   */
+  virtual bool supports_region() {
+    return false;
+  }
+
+  /**
+   * load part of a dataset
+   *
+   * offset and count are given in the same order as loader:dims; the
+   * last dimension is the fastest varying.
+   *
+   * \param[in] n the dataset to load from
+   * \param[in] offset the first element of the region in each dimension
+   * \param[in] count the number of elements of the region in each dimension
+   * \returns the region with dimensions count
+   */
+  virtual pressio_data load_region(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count);
+
   virtual std::unique_ptr<dataset_loader> clone() = 0;
 
+  /**
+   * load a dataset on a thread managed by the library
+   *
+   * loads run on a process-wide pool of threads shared by every loader.  The
+   * loader must outlive the load and may not be reconfigured until it has
+   * finished or been cancelled.
+   *
+   * \param[in] n the dataset to load
+   * \returns a handle to wait on or cancel the load
+   */
+  async_load load_data_async(size_t n);
+
+  /**
+   * load a dataset on a thread managed by the library and call then when it is done
+   *
+   * then is called with a ready future from the thread that finished the
+   * load, or from the thread that cancelled it.
+   *
+   * \param[in] n the dataset to load
+   * \param[in] then called once when the load finishes or is cancelled
+   * \returns a handle to cancel the load; its future is not valid
+   */
+  async_load load_data_async(size_t n, std::function<void(std::future<pressio_data>)> then);
+
+  /**
+   * \returns counters for the calls made to this loader and the loaders it
+   * uses, each under its own name (i.e. /cache/block_slicer:metrics:load_data:calls).
+   * Loaders that have not been named with set_name use their prefix instead,
+   * so name the outermost loader to tell the stages of a chain apart.
+   */
+  virtual pressio_options get_metrics_results() const {
+    return {};
+  }
+
   using pressio_errorable::set_error;
-  private:
+  protected:
+  uint64_t nthreads = 1;
 };
 
+/**
+ * a loader that implements the public methods with *_impl hooks
+ *
+ * the public methods count their calls, the bytes they return, and a histogram
+ * of their wall time, which includes the time spent in child loaders.  Clones
+ * share these counters with the loader they were cloned from, so work spread
+ * over clones (i.e. by load_all_data, or folder's children) is counted once per stage.
+ * When tracing is on (see trace.h), each call is also recorded as a span.
+ */
 class dataset_loader_base: public dataset_loader {
     size_t num_datasets() final {
-      return num_datasets_impl();
+      auto span = trace_call("num_datasets");
+      auto timer = metrics->num_datasets.start();
+      auto ret = num_datasets_impl();
+      timer.stop(0);
+      return ret;
     }
 
     int set_options(pressio_options const& options) final {
+      get(options, "loader:nthreads", &nthreads);
+      std::string trace_path;
+      if(get(options, "loader:trace", &trace_path) == pressio_options_key_set) {
+        if(trace_path.empty()) {
+          trace::stop();
+        } else {
+          trace::start(trace_path);
+        }
+      }
       return set_options_impl(options);
     }
 
     pressio_options get_options() const final {
-      return get_options_impl();
+      auto ret = get_options_impl();
+      set(ret, "loader:nthreads", nthreads);
+      set(ret, "loader:trace", trace::path());
+      return ret;
     }
 
     pressio_options get_documentation() const final {
-      return get_documentation_impl();
+      auto ret = get_documentation_impl();
+      set(ret, "loader:nthreads", "number of threads used by load_all_data and load_all_metadata");
+      set(ret, "loader:trace", "record the calls to every loader in the process as Chrome trace-event JSON to this file; "
+          "an empty string writes the trace and stops recording");
+      return ret;
     }
 
     pressio_options get_configuration() const final {
@@ -70,11 +245,79 @@ class dataset_loader_base: public dataset_loader {
     }
     
     pressio_data load_data(size_t n) final {
-      return load_data_impl(n);
+      auto span = trace_call("load_data", n);
+      auto timer = metrics->load_data.start();
+      auto ret = load_data_impl(n);
+      timer.stop(ret.size_in_bytes());
+      return ret;
     }
 
     pressio_options load_metadata(size_t n) final {
-      return load_metadata_impl(n);
+      auto span = trace_call("load_metadata", n);
+      auto timer = metrics->load_metadata.start();
+      auto ret = load_metadata_impl(n);
+      timer.stop(0);
+      return ret;
+    }
+
+    std::vector<pressio_data> load_data_batch(std::vector<size_t> const& indices) final {
+      auto span = trace_call("load_data_batch");
+      if(span) span.arg("count", indices.size());
+      auto timer = metrics->load_data_batch.start();
+      auto ret = load_data_batch_impl(indices);
+      uint64_t bytes = 0;
+      for (auto const& data : ret) {
+        bytes += data.size_in_bytes();
+      }
+      timer.stop(bytes);
+      return ret;
+    }
+
+    std::vector<pressio_options> load_metadata_batch(std::vector<size_t> const& indices) final {
+      auto span = trace_call("load_metadata_batch");
+      if(span) span.arg("count", indices.size());
+      auto timer = metrics->load_metadata_batch.start();
+      auto ret = load_metadata_batch_impl(indices);
+      timer.stop(0);
+      return ret;
+    }
+
+    bool supports_region() final {
+      return supports_region_impl();
+    }
+
+    pressio_data load_region(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) final {
+      auto span = trace_call("load_region", n);
+      auto timer = metrics->load_region.start();
+      auto ret = load_region_impl(n, offset, count);
+      timer.stop(ret.size_in_bytes());
+      return ret;
+    }
+
+    pressio_options get_metrics_results() const final {
+      pressio_options ret;
+      metrics->to_options(ret, stage_name());
+      ret.copy_from(get_metrics_results_impl());
+      return ret;
+    }
+
+    /**
+     * \returns the name used for this loader in metrics and traces
+     */
+    std::string stage_name() const {
+      return get_name().empty() ? std::string(prefix()) : get_name();
+    }
+
+    trace::span trace_call(const char* method) const {
+      trace::span span("loader", method);
+      if(span) span.arg("loader", stage_name());
+      return span;
+    }
+
+    trace::span trace_call(const char* method, size_t n) const {
+      trace::span span = trace_call(method);
+      if(span) span.arg("index", n);
+      return span;
     }
 
     virtual size_t num_datasets_impl()=0;
@@ -95,6 +338,13 @@ class dataset_loader_base: public dataset_loader {
       return {};
     }
 
+    /**
+     * \returns the metrics of the loaders this loader uses
+     */
+    virtual pressio_options get_metrics_results_impl() const {
+      return {};
+    }
+
     void set_name(std::string const& name) final {
       dataset_loader::set_name(name);
     }
@@ -102,6 +352,24 @@ class dataset_loader_base: public dataset_loader {
     virtual pressio_data load_data_impl(size_t n) =0;
 
     virtual pressio_options load_metadata_impl(size_t n) =0;
+
+    virtual std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) {
+      return dataset_loader::load_data_batch(indices);
+    }
+
+    virtual std::vector<pressio_options> load_metadata_batch_impl(std::vector<size_t> const& indices) {
+      return dataset_loader::load_metadata_batch(indices);
+    }
+
+    virtual bool supports_region_impl() {
+      return dataset_loader::supports_region();
+    }
+
+    virtual pressio_data load_region_impl(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) {
+      return dataset_loader::load_region(n, offset, count);
+    }
+
+    std::shared_ptr<loader_metrics> metrics = std::make_shared<loader_metrics>();
 };
 
 
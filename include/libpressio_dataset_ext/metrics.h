@@ -0,0 +1,126 @@
+#ifndef LIBPRESSIO_DATASET_METRICS_H_T6PL3XWA
+#define LIBPRESSIO_DATASET_METRICS_H_T6PL3XWA
+#include <libpressio_ext/cpp/options.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace libpressio_dataset {
+
+/**
+ * counters for calls to one method of a loader
+ *
+ * the counters are updated with relaxed atomics, so a method may be called from
+ * several threads at once.  Reading them while calls are in progress may show a
+ * call counted in one counter but not yet in another.
+ */
+class call_metrics {
+  public:
+    /**
+     * the number of histogram buckets; bucket 0 counts calls that took less
+     * than 1us, bucket i counts calls that took [2^(i-1), 2^i) us, and the last
+     * bucket also counts everything longer
+     */
+    static constexpr size_t buckets = 32;
+
+    /**
+     * records the time from its construction to stop() or its destruction;
+     * calls that end in an exception are counted as errors
+     */
+    class timer {
+      public:
+        explicit timer(call_metrics& metrics): metrics(&metrics), begin(std::chrono::steady_clock::now()) {}
+        timer(timer const&)=delete;
+        timer& operator=(timer const&)=delete;
+        ~timer() {
+          if(metrics) {
+            metrics->errors.fetch_add(1, std::memory_order_relaxed);
+            stop(0);
+          }
+        }
+
+        /**
+         * \param[in] bytes the size of what the call returned
+         */
+        void stop(uint64_t bytes) {
+          metrics->record(std::chrono::steady_clock::now() - begin, bytes);
+          metrics = nullptr;
+        }
+
+      private:
+        call_metrics* metrics;
+        std::chrono::steady_clock::time_point begin;
+    };
+
+    timer start() {
+      return timer(*this);
+    }
+
+    void record(std::chrono::steady_clock::duration elapsed, uint64_t bytes) {
+      const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      calls.fetch_add(1, std::memory_order_relaxed);
+      bytes_returned.fetch_add(bytes, std::memory_order_relaxed);
+      total_ns.fetch_add(ns, std::memory_order_relaxed);
+      uint64_t prev_max = max_ns.load(std::memory_order_relaxed);
+      while(prev_max < ns && !max_ns.compare_exchange_weak(prev_max, ns, std::memory_order_relaxed)) {}
+      size_t bucket = 0;
+      for (uint64_t us = ns / 1000; us != 0 && bucket + 1 < buckets; us >>= 1) {
+        ++bucket;
+      }
+      histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * add the counters to out under name's prefix as metrics:method:calls,
+     * :errors, :bytes, :total_ns, :max_ns, and :histogram
+     */
+    void to_options(pressio_options& out, std::string const& name, std::string const& method) const {
+      const std::string key = "metrics:" + method + ":";
+      out.set(name, key + "calls", calls.load(std::memory_order_relaxed));
+      out.set(name, key + "errors", errors.load(std::memory_order_relaxed));
+      out.set(name, key + "bytes", bytes_returned.load(std::memory_order_relaxed));
+      out.set(name, key + "total_ns", total_ns.load(std::memory_order_relaxed));
+      out.set(name, key + "max_ns", max_ns.load(std::memory_order_relaxed));
+      pressio_data counts = pressio_data::owning(pressio_uint64_dtype, {buckets});
+      auto ptr = static_cast<uint64_t*>(counts.data());
+      for (size_t i = 0; i < buckets; ++i) {
+        ptr[i] = histogram[i].load(std::memory_order_relaxed);
+      }
+      out.set(name, key + "histogram", std::move(counts));
+    }
+
+  private:
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> bytes_returned{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, buckets> histogram{};
+};
+
+/**
+ * the counters kept for each loader
+ */
+struct loader_metrics {
+  call_metrics num_datasets;
+  call_metrics load_data;
+  call_metrics load_metadata;
+  call_metrics load_data_batch;
+  call_metrics load_metadata_batch;
+  call_metrics load_region;
+
+  void to_options(pressio_options& out, std::string const& name) const {
+    num_datasets.to_options(out, name, "num_datasets");
+    load_data.to_options(out, name, "load_data");
+    load_metadata.to_options(out, name, "load_metadata");
+    load_data_batch.to_options(out, name, "load_data_batch");
+    load_metadata_batch.to_options(out, name, "load_metadata_batch");
+    load_region.to_options(out, name, "load_region");
+  }
+};
+
+}
+
+#endif /* end of include guard: LIBPRESSIO_DATASET_METRICS_H_T6PL3XWA */
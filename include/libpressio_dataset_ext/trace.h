@@ -0,0 +1,115 @@
+#ifndef LIBPRESSIO_DATASET_TRACE_H_F3HX9CQB
+#define LIBPRESSIO_DATASET_TRACE_H_F3HX9CQB
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace libpressio_dataset {
+
+/**
+ * records spans of work from every loader and thread as Chrome trace-event
+ * JSON, which can be opened in chrome://tracing or https://ui.perfetto.dev
+ *
+ * tracing is off unless the LIBPRESSIO_DATASET_TRACE environment variable
+ * names a file when the library is loaded, or a loader is given the
+ * loader:trace option.  The trace is written when tracing stops or the
+ * process exits.
+ */
+namespace trace {
+  namespace detail {
+    extern std::atomic<bool> enabled;
+  }
+
+  /**
+   * \returns true while events are being recorded
+   */
+  inline bool enabled() noexcept {
+    return detail::enabled.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * start recording events to be written to path, first writing any trace in progress to its file
+   *
+   * starting again with the path already being recorded to does nothing
+   */
+  void start(std::string const& path);
+
+  /**
+   * write the recorded events to their file and stop recording
+   */
+  void stop();
+
+  /**
+   * \returns the file being recorded to, or an empty string if tracing is off
+   */
+  std::string path();
+
+  /**
+   * record an event that happens at a point in time, i.e. a cache hit
+   *
+   * \param[in] category the kind of work, used to filter events in viewers
+   * \param[in] name what happened
+   * \param[in] args a JSON object of details or an empty string
+   */
+  void instant(const char* category, const char* name, std::string const& args = {});
+
+  /**
+   * \returns value quoted and escaped as a JSON string
+   */
+  std::string quote(std::string const& value);
+
+  /**
+   * a span of work on the current thread from construction to destruction
+   *
+   * spans constructed while tracing is off cost an atomic load and record nothing
+   */
+  class span {
+    public:
+      span(const char* category, const char* name) noexcept:
+        category(category), name(name), active(enabled())
+      {
+        if(active) begin = std::chrono::steady_clock::now();
+      }
+      span(span&& rhs) noexcept:
+        category(rhs.category), name(rhs.name), active(rhs.active), begin(rhs.begin), args(std::move(rhs.args))
+      {
+        rhs.active = false;
+      }
+      span(span const&)=delete;
+      span& operator=(span const&)=delete;
+      span& operator=(span&&)=delete;
+      ~span() {
+        if(active) end();
+      }
+
+      /**
+       * record the span now instead of when it is destroyed
+       */
+      void end();
+
+      /**
+       * \returns true if the span will be recorded, so details are worth computing
+       */
+      explicit operator bool() const noexcept {
+        return active;
+      }
+
+      /**
+       * attach a detail to the span
+       */
+      void arg(const char* key, std::string const& value);
+      void arg(const char* key, uint64_t value);
+
+    private:
+      const char* category;
+      const char* name;
+      bool active;
+      std::chrono::steady_clock::time_point begin;
+      std::string args;
+  };
+}
+
+}
+
+#endif /* end of include guard: LIBPRESSIO_DATASET_TRACE_H_F3HX9CQB */
@@ -0,0 +1,310 @@
+#ifndef LIBPRESSIO_DATASET_ASYNC_READER_H_H3ZP8WNE
+#define LIBPRESSIO_DATASET_ASYNC_READER_H_H3ZP8WNE
+#include <libpressio_ext/cpp/data.h>
+#include <cleanup.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if LIBPRESSIO_DATASET_HAS_URING
+#include <liburing.h>
+#endif
+namespace libpressio_dataset {
+
+namespace async_reader_detail {
+  //covers the logical block size of the devices O_DIRECT is used with
+  constexpr size_t direct_alignment = 4096;
+
+  inline void free_fn(void* data, void*) {
+    free(data);
+  }
+
+  /**
+   * a buffer for a raw file read into data with dtype and dims
+   *
+   * reads with O_DIRECT must cover whole blocks, so their buffers are aligned
+   * and rounded up to a whole number of blocks past the end of the data
+   */
+  struct read_buffer {
+    read_buffer(pressio_dtype dtype, std::vector<size_t> const& dims, bool direct) {
+      if(!direct) {
+        data = pressio_data::owning(dtype, dims);
+        bytes = capacity = data.size_in_bytes();
+        return;
+      }
+      bytes = pressio_data::empty(dtype, dims).size_in_bytes();
+      capacity = std::max<size_t>((bytes + direct_alignment - 1) / direct_alignment * direct_alignment, direct_alignment);
+      void* ptr = nullptr;
+      if(posix_memalign(&ptr, direct_alignment, capacity) != 0) {
+        throw std::bad_alloc();
+      }
+      data = pressio_data::move(dtype, ptr, dims, free_fn, nullptr);
+    }
+    unsigned char* ptr() {
+      return static_cast<unsigned char*>(data.data());
+    }
+
+    pressio_data data;
+    size_t bytes;
+    size_t capacity;
+  };
+
+  /**
+   * open path for reading, falling back to buffered reads where O_DIRECT is refused (i.e. tmpfs)
+   */
+  inline int open_for_read(std::string const& path, bool direct) {
+    int fd = -1;
+#ifdef O_DIRECT
+    if(direct) {
+      fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+      if(fd >= 0 || errno != EINVAL) {
+        if(fd < 0) throw std::runtime_error("failed to open " + path);
+        return fd;
+      }
+    }
+#else
+    (void)direct;
+#endif
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) throw std::runtime_error("failed to open " + path);
+    return fd;
+  }
+
+  /**
+   * raw reads start at the first byte, so a file with a header (i.e. .npy or HDF5)
+   * or of the wrong dims would be silently misread
+   *
+   * \throws std::runtime_error if fd is a regular file that is not exactly bytes long
+   */
+  inline void check_size(int fd, std::string const& path, size_t bytes) {
+    struct stat st;
+    if(fstat(fd, &st) != 0) throw std::runtime_error("failed to stat " + path);
+    if(S_ISREG(st.st_mode) && static_cast<size_t>(st.st_size) != bytes) {
+      throw std::runtime_error(path + " is " + std::to_string(st.st_size) + " bytes, but its dims and dtype describe " + std::to_string(bytes) + " bytes");
+    }
+  }
+}
+
+/**
+ * reads whole raw files in the background, keeping up to a fixed number of reads outstanding
+ *
+ * read may be called from several threads at once.  Destroying the reader
+ * waits for reads that have started; the futures of reads that have not yet
+ * started report std::future_errc::broken_promise.
+ */
+class async_reader {
+  public:
+    virtual ~async_reader()=default;
+
+    /**
+     * start reading path, which holds exactly the bytes of an array with dtype and dims
+     *
+     * if the size of path does not match, the read fails with std::runtime_error
+     */
+    virtual std::future<pressio_data> read(std::string const& path, pressio_dtype dtype, std::vector<size_t> const& dims) = 0;
+
+    /**
+     * \returns the name of the method used to read
+     */
+    virtual const char* backend() const = 0;
+};
+
+/**
+ * issues blocking preads from a pool of depth threads
+ */
+class pread_reader: public async_reader {
+  public:
+    pread_reader(size_t depth, bool direct): pool(std::max<size_t>(depth, 1)), direct(direct) {}
+
+    std::future<pressio_data> read(std::string const& path, pressio_dtype dtype, std::vector<size_t> const& dims) override {
+      const bool use_direct = direct;
+      return pool.submit([path, dtype, dims, use_direct](size_t) {
+          using namespace async_reader_detail;
+          read_buffer buffer(dtype, dims, use_direct);
+          int fd = open_for_read(path, use_direct);
+          auto cleanup_fd = make_cleanup([fd]{ close(fd); });
+          check_size(fd, path, buffer.bytes);
+          size_t done = 0;
+          while(done < buffer.bytes) {
+            ssize_t got = pread(fd, buffer.ptr() + done, buffer.capacity - done, done);
+            if(got < 0 && errno == EINTR) continue;
+            if(got <= 0) throw std::runtime_error("short read from " + path);
+            done += got;
+          }
+          return std::move(buffer.data);
+      });
+    }
+
+    const char* backend() const override {
+      return "pread";
+    }
+
+  private:
+    thread_pool pool;
+    bool direct;
+};
+
+#if LIBPRESSIO_DATASET_HAS_URING
+/**
+ * submits reads to an io_uring of depth entries; one thread reaps the completions
+ */
+class uring_reader: public async_reader {
+  struct operation {
+    std::string path;
+    int fd;
+    async_reader_detail::read_buffer buffer;
+    size_t done = 0;
+    std::promise<pressio_data> promise;
+  };
+  public:
+    /**
+     * \throws std::runtime_error if the kernel does not provide io_uring
+     */
+    uring_reader(size_t depth, bool direct): depth(std::max<size_t>(depth, 1)), direct(direct) {
+      int ret = io_uring_queue_init(static_cast<unsigned>(this->depth) + 1, &ring, 0);
+      if(ret < 0) {
+        throw std::runtime_error("io_uring is unavailable");
+      }
+      reaper = std::thread([this]{ reap(); });
+    }
+    ~uring_reader() override {
+      std::unique_lock<std::mutex> lock(mutex);
+      slots.wait(lock, [this]{ return inflight == 0; });
+      //a nop without user data tells the reaper to stop
+      io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+      io_uring_prep_nop(sqe);
+      io_uring_sqe_set_data(sqe, nullptr);
+      io_uring_submit(&ring);
+      lock.unlock();
+      reaper.join();
+      io_uring_queue_exit(&ring);
+    }
+
+    std::future<pressio_data> read(std::string const& path, pressio_dtype dtype, std::vector<size_t> const& dims) override {
+      using namespace async_reader_detail;
+      int fd = open_for_read(path, direct);
+      std::unique_ptr<operation> op;
+      try {
+        op.reset(new operation{path, fd, read_buffer(dtype, dims, direct), 0, std::promise<pressio_data>{}});
+      } catch(...) {
+        close(fd);
+        throw;
+      }
+      auto ret = op->promise.get_future();
+      try {
+        check_size(fd, path, op->buffer.bytes);
+      } catch(...) {
+        close(fd);
+        op->promise.set_exception(std::current_exception());
+        return ret;
+      }
+      if(op->buffer.bytes == 0) {
+        close(fd);
+        op->promise.set_value(std::move(op->buffer.data));
+        return ret;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      slots.wait(lock, [this]{ return inflight < depth; });
+      ++inflight;
+      submit(op.release());
+      return ret;
+    }
+
+    const char* backend() const override {
+      return "io_uring";
+    }
+
+  private:
+    /**
+     * queue the next read of op; requires mutex to be held
+     */
+    void submit(operation* op) {
+      io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+      //reads are limited to INT_MAX bytes, so large files take several
+      const size_t len = std::min<size_t>(op->buffer.capacity - op->done, size_t{1} << 30);
+      io_uring_prep_read(sqe, op->fd, op->buffer.ptr() + op->done, static_cast<unsigned>(len), op->done);
+      io_uring_sqe_set_data(sqe, op);
+      io_uring_submit(&ring);
+    }
+
+    void reap() {
+      while(true) {
+        io_uring_cqe* cqe;
+        if(io_uring_wait_cqe(&ring, &cqe) < 0) continue;
+        auto op = static_cast<operation*>(io_uring_cqe_get_data(cqe));
+        const int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        if(op == nullptr) return;
+
+        if(res == -EINTR || res == -EAGAIN) {
+          std::lock_guard<std::mutex> lock(mutex);
+          submit(op);
+          continue;
+        }
+        if(res > 0) {
+          op->done += res;
+          if(op->done < op->buffer.bytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            submit(op);
+            continue;
+          }
+        }
+        close(op->fd);
+        if(op->done >= op->buffer.bytes) {
+          op->promise.set_value(std::move(op->buffer.data));
+        } else {
+          op->promise.set_exception(std::make_exception_ptr(std::runtime_error("short read from " + op->path)));
+        }
+        delete op;
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          --inflight;
+        }
+        slots.notify_all();
+      }
+    }
+
+    const size_t depth;
+    const bool direct;
+    io_uring ring;
+    std::mutex mutex;
+    std::condition_variable slots;
+    size_t inflight = 0;
+    std::thread reaper;
+};
+#endif
+
+/**
+ * \param[in] backend one of auto, io_uring, or pread; auto uses io_uring when the kernel provides it
+ * \returns a reader that keeps up to depth reads outstanding
+ */
+inline std::unique_ptr<async_reader> make_async_reader(std::string const& backend, size_t depth, bool direct) {
+#if LIBPRESSIO_DATASET_HAS_URING
+  if(backend == "auto" || backend == "io_uring") {
+    try {
+      return std::make_unique<uring_reader>(depth, direct);
+    } catch(std::runtime_error const&) {
+      if(backend == "io_uring") throw;
+    }
+  }
+#else
+  if(backend == "io_uring") {
+    throw std::runtime_error("libpressio_dataset was built without io_uring support");
+  }
+#endif
+  return std::make_unique<pread_reader>(depth, direct);
+}
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_ASYNC_READER_H_H3ZP8WNE */
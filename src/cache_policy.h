@@ -0,0 +1,282 @@
+#ifndef LIBPRESSIO_DATASET_CACHE_POLICY_H_R3KX9T2B
+#define LIBPRESSIO_DATASET_CACHE_POLICY_H_R3KX9T2B
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+namespace libpressio_dataset {
+
+/**
+ * decides which cache entry to evict next
+ *
+ * the cache owns the entries; the policy only tracks keys and their sizes.
+ * every operation is O(1).
+ */
+class cache_policy {
+  public:
+    virtual ~cache_policy()=default;
+    /** a resident key was accessed; keys that are not resident are ignored */
+    virtual void hit(size_t key)=0;
+    /** a key is about to become resident; called before making room for it */
+    virtual void admit(size_t, size_t) {}
+    /** a key became resident */
+    virtual void insert(size_t key, size_t bytes)=0;
+    /** \returns the resident key to evict next; the cache must not be empty */
+    virtual size_t victim()=0;
+    /** a resident key was removed */
+    virtual void erase(size_t key)=0;
+    /** forget every key */
+    virtual void clear()=0;
+    virtual std::unique_ptr<cache_policy> clone() const=0;
+};
+
+/**
+ * evicts the least recently used entry
+ */
+class lru_cache_policy: public cache_policy {
+  public:
+    void hit(size_t key) override {
+      auto it = entries.find(key);
+      if(it != entries.end()) order.splice(order.begin(), order, it->second);
+    }
+    void insert(size_t key, size_t) override {
+      order.emplace_front(key);
+      entries[key] = order.begin();
+    }
+    size_t victim() override {
+      return order.back();
+    }
+    void erase(size_t key) override {
+      auto it = entries.find(key);
+      if(it == entries.end()) return;
+      order.erase(it->second);
+      entries.erase(it);
+    }
+    void clear() override {
+      order.clear();
+      entries.clear();
+    }
+    std::unique_ptr<cache_policy> clone() const override {
+      auto ret = std::make_unique<lru_cache_policy>();
+      for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        ret->insert(*it, 0);
+      }
+      return ret;
+    }
+  private:
+    std::list<size_t> order;
+    std::unordered_map<size_t, std::list<size_t>::iterator> entries;
+};
+
+/**
+ * evicts the least frequently used entry, breaking ties by recency
+ *
+ * keys are kept in a list of frequency buckets ordered by increasing frequency
+ * so that hits and evictions are constant time.
+ */
+class lfu_cache_policy: public cache_policy {
+  struct bucket {
+    size_t frequency;
+    std::list<size_t> keys;
+  };
+  using bucket_iterator = std::list<bucket>::iterator;
+  struct entry {
+    bucket_iterator bucket;
+    std::list<size_t>::iterator position;
+  };
+  public:
+    void hit(size_t key) override {
+      auto it = entries.find(key);
+      if(it == entries.end()) return;
+      auto current = it->second.bucket;
+      auto next = std::next(current);
+      if(next == buckets.end() || next->frequency != current->frequency + 1) {
+        next = buckets.insert(next, bucket{current->frequency + 1, {}});
+      }
+      next->keys.splice(next->keys.begin(), current->keys, it->second.position);
+      it->second.bucket = next;
+      if(current->keys.empty()) buckets.erase(current);
+    }
+    void insert(size_t key, size_t) override {
+      if(buckets.empty() || buckets.front().frequency != 1) {
+        buckets.emplace_front(bucket{1, {}});
+      }
+      buckets.front().keys.emplace_front(key);
+      entries[key] = entry{buckets.begin(), buckets.front().keys.begin()};
+    }
+    size_t victim() override {
+      return buckets.front().keys.back();
+    }
+    void erase(size_t key) override {
+      auto it = entries.find(key);
+      if(it == entries.end()) return;
+      auto b = it->second.bucket;
+      b->keys.erase(it->second.position);
+      if(b->keys.empty()) buckets.erase(b);
+      entries.erase(it);
+    }
+    void clear() override {
+      buckets.clear();
+      entries.clear();
+    }
+    std::unique_ptr<cache_policy> clone() const override {
+      auto ret = std::make_unique<lfu_cache_policy>();
+      for (auto const& b : buckets) {
+        auto nb = ret->buckets.insert(ret->buckets.end(), bucket{b.frequency, b.keys});
+        for (auto it = nb->keys.begin(); it != nb->keys.end(); ++it) {
+          ret->entries[*it] = entry{nb, it};
+        }
+      }
+      return ret;
+    }
+  private:
+    std::list<bucket> buckets;
+    std::unordered_map<size_t, entry> entries;
+};
+
+/**
+ * adaptive replacement cache (Megiddo and Modha) measured in bytes rather than entries
+ *
+ * resident keys live in t1 (seen once recently) or t2 (seen at least twice);
+ * b1 and b2 remember recently evicted keys from each list and steer the target
+ * size p of t1.
+ */
+class arc_cache_policy: public cache_policy {
+  enum class list_id { t1, t2, b1, b2 };
+  struct entry {
+    list_id list;
+    std::list<size_t>::iterator position;
+    size_t bytes;
+  };
+  public:
+    explicit arc_cache_policy(size_t capacity): capacity(capacity) {}
+
+    void hit(size_t key) override {
+      auto it = entries.find(key);
+      if(it == entries.end() || it->second.list == list_id::b1 || it->second.list == list_id::b2) return;
+      move_to(it->second, key, list_id::t2);
+    }
+    void admit(size_t key, size_t bytes) override {
+      auto it = entries.find(key);
+      last_insert_from_b2 = false;
+      if(it == entries.end()) return;
+      if(it->second.list == list_id::b1) {
+        //a recently evicted key from t1 came back: favor recency
+        const size_t delta = std::max<size_t>(sizes[idx(list_id::b2)] / std::max<size_t>(sizes[idx(list_id::b1)], 1), 1) * bytes;
+        p = std::min(capacity, p + delta);
+      } else if(it->second.list == list_id::b2) {
+        //a recently evicted key from t2 came back: favor frequency
+        const size_t delta = std::max<size_t>(sizes[idx(list_id::b1)] / std::max<size_t>(sizes[idx(list_id::b2)], 1), 1) * bytes;
+        p = (delta > p) ? 0 : p - delta;
+        last_insert_from_b2 = true;
+      }
+    }
+    void insert(size_t key, size_t bytes) override {
+      auto it = entries.find(key);
+      if(it != entries.end()) {
+        //seen before and remembered in a ghost list
+        resize(it->second, bytes);
+        move_to(it->second, key, list_id::t2);
+      } else {
+        lists[idx(list_id::t1)].emplace_front(key);
+        entries[key] = entry{list_id::t1, lists[idx(list_id::t1)].begin(), bytes};
+        sizes[idx(list_id::t1)] += bytes;
+      }
+      trim_ghosts();
+    }
+    size_t victim() override {
+      const size_t t1 = sizes[idx(list_id::t1)];
+      if(!lists[idx(list_id::t1)].empty() && (t1 > p || (last_insert_from_b2 && t1 == p) || lists[idx(list_id::t2)].empty())) {
+        return lists[idx(list_id::t1)].back();
+      }
+      return lists[idx(list_id::t2)].back();
+    }
+    void erase(size_t key) override {
+      auto it = entries.find(key);
+      if(it == entries.end()) return;
+      //resident keys are remembered in the matching ghost list
+      if(it->second.list == list_id::t1) {
+        move_to(it->second, key, list_id::b1);
+      } else if(it->second.list == list_id::t2) {
+        move_to(it->second, key, list_id::b2);
+      }
+      trim_ghosts();
+    }
+    void clear() override {
+      for (auto& l : lists) l.clear();
+      for (auto& s : sizes) s = 0;
+      entries.clear();
+      p = 0;
+    }
+    std::unique_ptr<cache_policy> clone() const override {
+      auto ret = std::make_unique<arc_cache_policy>(capacity);
+      ret->p = p;
+      ret->last_insert_from_b2 = last_insert_from_b2;
+      ret->lists = lists;
+      ret->sizes = sizes;
+      for (size_t l = 0; l < 4; ++l) {
+        for (auto it = ret->lists[l].begin(); it != ret->lists[l].end(); ++it) {
+          ret->entries[*it] = entry{static_cast<list_id>(l), it, entries.at(*it).bytes};
+        }
+      }
+      return ret;
+    }
+  private:
+    static size_t idx(list_id l) { return static_cast<size_t>(l); }
+
+    void move_to(entry& e, size_t key, list_id to) {
+      sizes[idx(e.list)] -= e.bytes;
+      lists[idx(e.list)].erase(e.position);
+      lists[idx(to)].emplace_front(key);
+      e.list = to;
+      e.position = lists[idx(to)].begin();
+      sizes[idx(to)] += e.bytes;
+    }
+    void resize(entry& e, size_t bytes) {
+      sizes[idx(e.list)] -= e.bytes;
+      e.bytes = bytes;
+      sizes[idx(e.list)] += e.bytes;
+    }
+    void drop_lru(list_id l) {
+      size_t key = lists[idx(l)].back();
+      sizes[idx(l)] -= entries.at(key).bytes;
+      lists[idx(l)].pop_back();
+      entries.erase(key);
+    }
+    void trim_ghosts() {
+      auto& b1 = lists[idx(list_id::b1)];
+      auto& b2 = lists[idx(list_id::b2)];
+      while(!b1.empty() && sizes[idx(list_id::t1)] + sizes[idx(list_id::b1)] > capacity) {
+        drop_lru(list_id::b1);
+      }
+      while(!b2.empty() && sizes[0] + sizes[1] + sizes[2] + sizes[3] > 2 * capacity) {
+        drop_lru(list_id::b2);
+      }
+    }
+
+    size_t capacity;
+    size_t p = 0;
+    bool last_insert_from_b2 = false;
+    std::array<std::list<size_t>, 4> lists;
+    std::array<size_t, 4> sizes{};
+    std::unordered_map<size_t, entry> entries;
+};
+
+/**
+ * \param[in] name one of lru, lfu, or arc
+ * \param[in] capacity the budget of the cache in bytes
+ * \returns a new policy of the requested kind
+ */
+inline std::unique_ptr<cache_policy> make_cache_policy(std::string const& name, size_t capacity) {
+  if(name == "lru") return std::make_unique<lru_cache_policy>();
+  if(name == "lfu") return std::make_unique<lfu_cache_policy>();
+  if(name == "arc") return std::make_unique<arc_cache_policy>(capacity);
+  throw std::runtime_error("unsupported cache policy " + name);
+}
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_CACHE_POLICY_H_R3KX9T2B */
@@ -0,0 +1,83 @@
+#ifndef LIBPRESSIO_DATASET_CLONE_POOL_H_V7NW2KQC
+#define LIBPRESSIO_DATASET_CLONE_POOL_H_V7NW2KQC
+#include <mutex>
+#include <utility>
+#include <vector>
+namespace libpressio_dataset {
+
+/**
+ * copies of a plugin that is configured before each use, one per concurrent caller
+ *
+ * loaders that set per-call options on a child (i.e. io:path) can't share that
+ * child between threads.  Instead each call leases a copy: idle copies are
+ * reused, and a new copy of the prototype is made only when every existing copy
+ * is in use.  T is copied with its copy constructor, which for the plugin
+ * handles clones the plugin.
+ *
+ * copies of the pool start empty, and clear must be called whenever the
+ * prototype is reconfigured.
+ */
+template <class T>
+class clone_pool {
+  public:
+    class lease {
+      public:
+        lease(clone_pool& pool, T&& item): pool(&pool), item(std::move(item)) {}
+        lease(lease&& rhs) noexcept: pool(rhs.pool), item(std::move(rhs.item)) {
+          rhs.pool = nullptr;
+        }
+        lease(lease const&)=delete;
+        lease& operator=(lease const&)=delete;
+        lease& operator=(lease&&)=delete;
+        ~lease() {
+          if(pool) pool->release(std::move(item));
+        }
+        T& operator*() { return item; }
+        T& operator->() { return item; }
+      private:
+        clone_pool* pool;
+        T item;
+    };
+
+    clone_pool()=default;
+    clone_pool(clone_pool const&) {}
+    clone_pool& operator=(clone_pool const&) {
+      clear();
+      return *this;
+    }
+
+    /**
+     * \returns an idle copy of prototype, making a new copy if none is idle
+     */
+    lease acquire(T const& prototype) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!idle.empty()) {
+          T item = std::move(idle.back());
+          idle.pop_back();
+          return lease(*this, std::move(item));
+        }
+      }
+      return lease(*this, T(prototype));
+    }
+
+    /**
+     * drop the idle copies
+     */
+    void clear() {
+      std::lock_guard<std::mutex> lock(mutex);
+      idle.clear();
+    }
+
+  private:
+    void release(T&& item) {
+      std::lock_guard<std::mutex> lock(mutex);
+      idle.emplace_back(std::move(item));
+    }
+
+    std::mutex mutex;
+    std::vector<T> idle;
+};
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_CLONE_POOL_H_V7NW2KQC */
@@ -0,0 +1,76 @@
+#include <libpressio_dataset_ext/cursor.h>
+#include <spsc_ring.h>
+#include <atomic>
+#include <exception>
+#include <numeric>
+#include <thread>
+
+namespace libpressio_dataset {
+
+struct dataset_cursor::impl {
+  impl(dataset_loader& loader, std::vector<size_t> indices, size_t depth):
+    loader(loader),
+    indices(std::move(indices)),
+    ring(depth)
+  {
+    producer = std::thread([this]{ produce(); });
+  }
+  ~impl() {
+    ring.close();
+    producer.join();
+  }
+
+  void produce() {
+    for (auto index : indices) {
+      cursor_item item;
+      try {
+        item.index = index;
+        item.data = loader.load_data(index);
+        item.metadata = loader.load_metadata(index);
+      } catch(...) {
+        //published before close so the consumer sees it once the items before it are consumed
+        error = std::current_exception();
+        break;
+      }
+      if(!ring.push(std::move(item))) return;
+    }
+    ring.close();
+  }
+
+  dataset_loader& loader;
+  const std::vector<size_t> indices;
+  spsc_ring<cursor_item> ring;
+  std::exception_ptr error;
+  std::thread producer;
+};
+
+static std::vector<size_t> all_indices(dataset_loader& loader) {
+  std::vector<size_t> indices(loader.num_datasets());
+  std::iota(indices.begin(), indices.end(), 0);
+  return indices;
+}
+
+dataset_cursor::dataset_cursor(dataset_loader& loader, size_t depth):
+  dataset_cursor(loader, all_indices(loader), depth)
+{}
+
+dataset_cursor::dataset_cursor(dataset_loader& loader, std::vector<size_t> indices, size_t depth):
+  state(std::make_unique<impl>(loader, std::move(indices), depth))
+{}
+
+dataset_cursor::~dataset_cursor()=default;
+
+bool dataset_cursor::next(cursor_item& item) {
+  if(state->ring.pop(item)) {
+    return true;
+  }
+  //the ring is closed and drained, so the producer has finished writing error
+  if(state->error) {
+    auto error = state->error;
+    state->error = nullptr;
+    std::rethrow_exception(error);
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,262 @@
+#ifndef LIBPRESSIO_DATASET_DISK_CACHE_H_M5YV2QJ8
+#define LIBPRESSIO_DATASET_DISK_CACHE_H_M5YV2QJ8
+#include <libpressio_ext/cpp/data.h>
+#include <libpressio_ext/cpp/options.h>
+#include <std_compat/optional.h>
+#include <cleanup.h>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+namespace libpressio_dataset {
+
+namespace disk_cache_detail {
+  inline void fnv1a(uint64_t& hash, const void* ptr, size_t len) {
+    auto bytes = static_cast<const unsigned char*>(ptr);
+    for (size_t i = 0; i < len; ++i) {
+      hash ^= bytes[i];
+      hash *= 0x100000001b3ull;
+    }
+  }
+  inline void fnv1a(uint64_t& hash, std::string const& str) {
+    fnv1a(hash, str.data(), str.size());
+    fnv1a(hash, "", 1);
+  }
+  template <class T>
+  void fnv1a_value(uint64_t& hash, pressio_option const& option) {
+    T const& value = option.get_value<T>();
+    fnv1a(hash, &value, sizeof(T));
+  }
+  inline bool ends_with(std::string const& str, std::string const& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  inline void unmap_fn(void* data, void* metadata) {
+    size_t* len = static_cast<size_t*>(metadata);
+    munmap(data, *len);
+    delete len;
+  }
+}
+
+/**
+ * hashes the options that determine what a loader returns
+ *
+ * runtime statistics and process-wide settings (i.e. loader:trace) reported
+ * through get_options are skipped so that the hash is stable from run to run.
+ * Settings that only change how fast the data is loaded, and folder:paths, which
+ * is filled in from the other folder options once the folder is scanned, are
+ * skipped so that they can be tuned without losing what was cached.
+ */
+inline uint64_t configuration_hash(std::string const& id, pressio_options const& options) {
+  using namespace disk_cache_detail;
+  static const std::vector<std::string> runtime_keys {
+    "cache:hits", "cache:misses", "cache:coalesced", "cache:evictions", "cache:resident_bytes",
+    "cache:disk_hits", "cache:disk_writes", "loader:nthreads", "loader:trace"
+  };
+  static const std::vector<std::string> performance_keys {
+    "cache:max_bytes", "cache:policy", "cache:shards", "cache:disk_dir",
+    "folder:scan_threads", "folder:queue_depth", "folder:async_backend", "folder:direct", "folder:manifest", "folder:paths",
+    "hdf5_datasets:decode_threads", "hdf5_datasets:open_datasets",
+    "block_slicer:parents", "block_sampler:parents",
+    "prefetch:depth", "prefetch:nthreads",
+    "io_loader:probe",
+    "mmap:advice", "mmap:huge_pages", "mmap:keep_mapped",
+    "random_sampler:dedup", "random_sampler:dedup_entries",
+    "synthetic:nthreads"
+  };
+  auto skipped = [&](std::string const& key) {
+    auto matches = [&](std::string const& k){ return ends_with(key, k); };
+    return std::any_of(runtime_keys.begin(), runtime_keys.end(), matches) ||
+      std::any_of(performance_keys.begin(), performance_keys.end(), matches);
+  };
+  uint64_t hash = 0xcbf29ce484222325ull;
+  fnv1a(hash, id);
+  for (auto const& option : options) {
+    if(skipped(option.first)) continue;
+    fnv1a(hash, option.first);
+    const pressio_option_type type = option.second.type();
+    fnv1a(hash, &type, sizeof(type));
+    if(!option.second.has_value()) continue;
+    switch(type) {
+      case pressio_option_int8_type: fnv1a_value<int8_t>(hash, option.second); break;
+      case pressio_option_uint8_type: fnv1a_value<uint8_t>(hash, option.second); break;
+      case pressio_option_int16_type: fnv1a_value<int16_t>(hash, option.second); break;
+      case pressio_option_uint16_type: fnv1a_value<uint16_t>(hash, option.second); break;
+      case pressio_option_int32_type: fnv1a_value<int32_t>(hash, option.second); break;
+      case pressio_option_uint32_type: fnv1a_value<uint32_t>(hash, option.second); break;
+      case pressio_option_int64_type: fnv1a_value<int64_t>(hash, option.second); break;
+      case pressio_option_uint64_type: fnv1a_value<uint64_t>(hash, option.second); break;
+      case pressio_option_float_type: fnv1a_value<float>(hash, option.second); break;
+      case pressio_option_double_type: fnv1a_value<double>(hash, option.second); break;
+      case pressio_option_bool_type: fnv1a_value<bool>(hash, option.second); break;
+      case pressio_option_dtype_type: fnv1a_value<pressio_dtype>(hash, option.second); break;
+      case pressio_option_charptr_type:
+        fnv1a(hash, option.second.get_value<std::string>());
+        break;
+      case pressio_option_charptr_array_type:
+        for (auto const& str : option.second.get_value<std::vector<std::string>>()) {
+          fnv1a(hash, str);
+        }
+        break;
+      case pressio_option_data_type:
+        {
+          auto const& data = option.second.get_value<pressio_data>();
+          const pressio_dtype dtype = data.dtype();
+          fnv1a(hash, &dtype, sizeof(dtype));
+          for (auto d : data.dimensions()) {
+            fnv1a(hash, &d, sizeof(d));
+          }
+          if(data.has_data()) fnv1a(hash, data.data(), data.size_in_bytes());
+        }
+        break;
+      default:
+        //pointers and other process local values can't be hashed meaningfully
+        break;
+    }
+  }
+  return hash;
+}
+
+/**
+ * a directory of raw buffers plus an append-only index describing them
+ *
+ * entries are written once and never modified, so several processes may
+ * share a directory.  loads map the buffers into memory rather than reading them.
+ * loads and stores may be called concurrently.
+ */
+class disk_cache {
+  struct entry {
+    pressio_dtype dtype = pressio_byte_dtype;
+    std::vector<size_t> dims;
+  };
+  public:
+    explicit disk_cache(std::string dir): dir(std::move(dir)) {}
+
+    /**
+     * \returns the data for index n mapped from disk if it is present
+     */
+    compat::optional<pressio_data> load(size_t n) {
+      entry e;
+      {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        auto it = index.find(n);
+        if(it == index.end()) {
+          refresh_index();
+          it = index.find(n);
+          if(it == index.end()) return {};
+        }
+        e = it->second;
+      }
+      const size_t bytes = pressio_data::empty(e.dtype, e.dims).size_in_bytes();
+      if(bytes == 0) return pressio_data::owning(e.dtype, e.dims);
+
+      int fd = open(data_path(n).c_str(), O_RDONLY);
+      if(fd < 0) return {};
+      auto cleanup_fd = make_cleanup([fd]{ close(fd); });
+      struct stat s;
+      if(fstat(fd, &s) != 0 || static_cast<size_t>(s.st_size) != bytes) return {};
+      //private mappings let callers modify the data without changing the cache
+      void* ptr = mmap(nullptr, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if(ptr == MAP_FAILED) return {};
+      return pressio_data::move(e.dtype, ptr, e.dims, disk_cache_detail::unmap_fn, new size_t(bytes));
+    }
+
+    /**
+     * write data for index n to disk
+     *
+     * \returns true if the entry was written
+     */
+    bool store(size_t n, pressio_data const& data) {
+      std::error_code ec;
+      std::filesystem::create_directories(dir, ec);
+      if(ec) return false;
+
+      const std::string path = data_path(n);
+      const std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+      {
+        std::ofstream out(tmp_path, std::ios::binary);
+        out.write(static_cast<const char*>(data.data()), data.size_in_bytes());
+        if(!out) {
+          std::filesystem::remove(tmp_path, ec);
+          return false;
+        }
+      }
+      if(std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+      }
+
+      std::stringstream line;
+      line << n << ' ' << static_cast<int>(data.dtype()) << ' ' << data.num_dimensions();
+      for (auto d : data.dimensions()) {
+        line << ' ' << d;
+      }
+      line << '\n';
+      const std::string str = line.str();
+      int fd = open(index_path().c_str(), O_WRONLY|O_APPEND|O_CREAT, 0644);
+      if(fd < 0) return false;
+      auto cleanup_fd = make_cleanup([fd]{ close(fd); });
+      //a single append is atomic so concurrent writers can't interleave lines
+      if(write(fd, str.data(), str.size()) != static_cast<ssize_t>(str.size())) return false;
+      std::lock_guard<std::mutex> lock(index_mutex);
+      index[n] = entry{data.dtype(), data.dimensions()};
+      return true;
+    }
+
+  private:
+    std::string data_path(size_t n) const {
+      return dir + "/" + std::to_string(n) + ".raw";
+    }
+    std::string index_path() const {
+      return dir + "/index";
+    }
+
+    /**
+     * read entries appended to the index since it was last read
+     */
+    void refresh_index() {
+      std::ifstream in(index_path());
+      if(!in) return;
+      in.seekg(index_offset);
+      std::string line;
+      while(std::getline(in, line)) {
+        if(in.eof()) break; //partially written line, retry on the next refresh
+        std::istringstream ss(line);
+        size_t n, ndims;
+        int dtype;
+        if(!(ss >> n >> dtype >> ndims)) continue;
+        std::vector<size_t> dims(ndims);
+        for (auto& d : dims) ss >> d;
+        if(!ss) continue;
+        index[n] = entry{static_cast<pressio_dtype>(dtype), std::move(dims)};
+        index_offset = in.tellg();
+      }
+    }
+
+    std::string dir;
+    std::mutex index_mutex;
+    std::map<size_t, entry> index;
+    std::streamoff index_offset = 0;
+};
+
+/**
+ * \returns the directory used for a loader with the given configuration hash under base
+ */
+inline std::string disk_cache_dir(std::string const& base, uint64_t hash) {
+  std::stringstream ss;
+  ss << base << '/' << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_DISK_CACHE_H_M5YV2QJ8 */
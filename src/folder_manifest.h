@@ -0,0 +1,244 @@
+#ifndef LIBPRESSIO_DATASET_FOLDER_MANIFEST_H_Q8XK3ZTD
+#define LIBPRESSIO_DATASET_FOLDER_MANIFEST_H_Q8XK3ZTD
+#include <pressio_dtype.h>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+namespace libpressio_dataset {
+
+/**
+ * the results of a previous folder search, saved to a text file
+ *
+ * each directory is recorded with its modification time, the matching files it
+ * contains, and its subdirectories.  A directory's modification time changes
+ * whenever an entry is added, removed, or renamed in it, so a directory whose
+ * time is unchanged does not need to be listed again.
+ *
+ * the dims and dtype of files are also recorded along with the file's
+ * modification time and a hash of the configuration of the loader that read them.
+ *
+ * each line is a kind and its fields separated by tabs with any path last;
+ * the numeric fields of M lines are separated by spaces:
+ *
+ *     libpressio_dataset folder manifest 1
+ *     base_dir <base_dir>
+ *     regex <regex>
+ *     recursive <0|1>
+ *     D <mtime> <directory>
+ *     F <matching file in the preceding directory>
+ *     S <subdirectory of the preceding directory>
+ *     M <mtime> <loader hash> <dtype> <ndims> <dims...> <file>
+ */
+struct folder_manifest {
+  struct directory {
+    int64_t mtime = 0;
+    std::vector<std::string> files;
+    std::vector<std::string> subdirs;
+  };
+  struct file_metadata {
+    int64_t mtime = 0;
+    uint64_t loader_hash = 0;
+    pressio_dtype dtype = pressio_byte_dtype;
+    std::vector<size_t> dims;
+  };
+  using directory_map = std::unordered_map<std::string, directory>;
+
+  explicit folder_manifest(std::string path): path(std::move(path)) {
+    load();
+  }
+  folder_manifest(folder_manifest const&)=delete;
+  folder_manifest& operator=(folder_manifest const&)=delete;
+  ~folder_manifest() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(dirty) save();
+  }
+
+  /**
+   * \returns the directories recorded by a search with the same settings, leaving none behind
+   */
+  directory_map take_directories(std::string const& new_base_dir, std::string const& new_regex, bool new_recursive) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(new_base_dir != base_dir || new_regex != regex || new_recursive != recursive) {
+      return {};
+    }
+    return std::move(directories);
+  }
+
+  /**
+   * record the directories found by a search and write the manifest
+   */
+  void set_directories(std::string new_base_dir, std::string new_regex, bool new_recursive, directory_map new_directories) {
+    std::lock_guard<std::mutex> lock(mutex);
+    base_dir = std::move(new_base_dir);
+    regex = std::move(new_regex);
+    recursive = new_recursive;
+    directories = std::move(new_directories);
+    save();
+  }
+
+  /**
+   * \returns true and fills in dims and dtype if metadata for file was recorded with the same mtime and loader_hash
+   */
+  bool find_metadata(std::string const& file, int64_t mtime, uint64_t loader_hash, std::vector<size_t>& dims, pressio_dtype& dtype) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = metadata.find(file);
+    if(it == metadata.end() || it->second.mtime != mtime || it->second.loader_hash != loader_hash) {
+      return false;
+    }
+    dims = it->second.dims;
+    dtype = it->second.dtype;
+    return true;
+  }
+
+  /**
+   * record the metadata for a file; it is written when the manifest is next saved
+   */
+  void set_metadata(std::string const& file, file_metadata entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    metadata[file] = std::move(entry);
+    dirty = true;
+  }
+
+  /**
+   * \returns the modification time of path in the units used by the manifest
+   */
+  static int64_t mtime(std::filesystem::path const& path, std::error_code& ec) {
+    return std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+  }
+
+  private:
+  /**
+   * read the manifest; a missing or malformed manifest is treated as empty
+   */
+  void load() {
+    std::ifstream in(path);
+    if(!in) return;
+    std::string line;
+    if(!std::getline(in, line) || line != header) return;
+
+    std::string new_base_dir, new_regex;
+    bool new_recursive = false;
+    directory_map new_directories;
+    std::unordered_map<std::string, file_metadata> new_metadata;
+    directory* current = nullptr;
+    while(std::getline(in, line)) {
+      const size_t tab = line.find('\t');
+      if(tab == std::string::npos) return;
+      const std::string kind = line.substr(0, tab);
+      std::string rest = line.substr(tab + 1);
+      if(kind == "base_dir") {
+        new_base_dir = std::move(rest);
+      } else if(kind == "regex") {
+        new_regex = std::move(rest);
+      } else if(kind == "recursive") {
+        new_recursive = rest == "1";
+      } else if(kind == "D") {
+        directory dir;
+        std::string name;
+        if(!split_mtime(rest, dir.mtime, name)) return;
+        current = &(new_directories[name] = std::move(dir));
+      } else if(kind == "F" || kind == "S") {
+        if(current == nullptr) return;
+        (kind == "F" ? current->files : current->subdirs).emplace_back(std::move(rest));
+      } else if(kind == "M") {
+        std::istringstream ss(rest);
+        file_metadata entry;
+        int dtype;
+        size_t ndims;
+        if(!(ss >> entry.mtime >> entry.loader_hash >> dtype >> ndims)) return;
+        entry.dtype = static_cast<pressio_dtype>(dtype);
+        entry.dims.resize(ndims);
+        for (auto& d : entry.dims) ss >> d;
+        if(!ss || ss.get() != '\t') return;
+        std::string name;
+        std::getline(ss, name);
+        new_metadata[name] = std::move(entry);
+      } else {
+        return;
+      }
+    }
+    base_dir = std::move(new_base_dir);
+    regex = std::move(new_regex);
+    recursive = new_recursive;
+    directories = std::move(new_directories);
+    metadata = std::move(new_metadata);
+  }
+
+  static bool split_mtime(std::string const& rest, int64_t& mtime, std::string& name) {
+    const size_t tab = rest.find('\t');
+    if(tab == std::string::npos) return false;
+    try {
+      mtime = std::stoll(rest.substr(0, tab));
+    } catch(std::exception const&) {
+      return false;
+    }
+    name = rest.substr(tab + 1);
+    return true;
+  }
+
+  /**
+   * write the manifest; requires the mutex to be held
+   *
+   * the manifest is written to a temporary file and renamed into place so
+   * readers never see a partial manifest.  Failures are ignored since the
+   * manifest only saves time.
+   */
+  void save() {
+    const std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream out(tmp_path);
+      out << header << '\n';
+      out << "base_dir\t" << base_dir << '\n';
+      out << "regex\t" << regex << '\n';
+      out << "recursive\t" << (recursive ? 1 : 0) << '\n';
+      for (auto const& dir : directories) {
+        out << "D\t" << dir.second.mtime << '\t' << dir.first << '\n';
+        for (auto const& file : dir.second.files) {
+          out << "F\t" << file << '\n';
+        }
+        for (auto const& subdir : dir.second.subdirs) {
+          out << "S\t" << subdir << '\n';
+        }
+      }
+      for (auto const& file : metadata) {
+        auto const& entry = file.second;
+        out << "M\t" << entry.mtime << ' ' << entry.loader_hash << ' ' << static_cast<int>(entry.dtype) << ' ' << entry.dims.size();
+        for (auto d : entry.dims) {
+          out << ' ' << d;
+        }
+        out << '\t' << file.first << '\n';
+      }
+      if(!out) {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        return;
+      }
+    }
+    if(std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::error_code ec;
+      std::filesystem::remove(tmp_path, ec);
+      return;
+    }
+    dirty = false;
+  }
+
+  static constexpr const char* header = "libpressio_dataset folder manifest 1";
+  const std::string path;
+  std::mutex mutex;
+  std::string base_dir;
+  std::string regex;
+  bool recursive = false;
+  directory_map directories;
+  std::unordered_map<std::string, file_metadata> metadata;
+  bool dirty = false;
+};
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_FOLDER_MANIFEST_H_Q8XK3ZTD */
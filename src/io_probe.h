@@ -0,0 +1,117 @@
+#ifndef LIBPRESSIO_DATASET_IO_PROBE_H_W7RC2MQA
+#define LIBPRESSIO_DATASET_IO_PROBE_H_W7RC2MQA
+#include <pressio_dtype.h>
+#include <std_compat/optional.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+namespace libpressio_dataset {
+
+/**
+ * the dims and dtype of a file learned without reading its data
+ */
+struct probed_metadata {
+  std::vector<size_t> dims;
+  pressio_dtype dtype;
+};
+
+namespace io_probe_detail {
+  inline std::string npy_field(std::string const& header, std::string const& key) {
+    const size_t pos = header.find("'" + key + "'");
+    if(pos == std::string::npos) return {};
+    const size_t colon = header.find(':', pos);
+    if(colon == std::string::npos) return {};
+    const size_t begin = header.find_first_not_of(' ', colon + 1);
+    if(begin == std::string::npos) return {};
+    size_t end;
+    if(header[begin] == '(') {
+      end = header.find(')', begin);
+      return (end == std::string::npos) ? std::string{} : header.substr(begin, end - begin + 1);
+    } else if(header[begin] == '\'') {
+      end = header.find('\'', begin + 1);
+      return (end == std::string::npos) ? std::string{} : header.substr(begin + 1, end - begin - 1);
+    }
+    end = header.find_first_of(",}", begin);
+    return header.substr(begin, end - begin);
+  }
+
+  inline compat::optional<pressio_dtype> npy_dtype(std::string const& descr) {
+    if(descr.size() < 3) return {};
+    const char kind = descr[1];
+    const std::string size = descr.substr(2);
+    if(kind == 'f' && size == "4") return pressio_float_dtype;
+    if(kind == 'f' && size == "8") return pressio_double_dtype;
+    if(kind == 'i' && size == "1") return pressio_int8_dtype;
+    if(kind == 'i' && size == "2") return pressio_int16_dtype;
+    if(kind == 'i' && size == "4") return pressio_int32_dtype;
+    if(kind == 'i' && size == "8") return pressio_int64_dtype;
+    if(kind == 'u' && size == "1") return pressio_uint8_dtype;
+    if(kind == 'u' && size == "2") return pressio_uint16_dtype;
+    if(kind == 'u' && size == "4") return pressio_uint32_dtype;
+    if(kind == 'u' && size == "8") return pressio_uint64_dtype;
+    if(kind == 'b' && size == "1") return pressio_bool_dtype;
+    return {};
+  }
+}
+
+/**
+ * read the header of a numpy .npy file
+ *
+ * \returns nothing if path is not a .npy file, or is one the probe does not
+ * understand (i.e. structured dtypes or fortran order), so the caller should read it in full
+ */
+inline compat::optional<probed_metadata> probe_npy(std::string const& path) {
+  using namespace io_probe_detail;
+  std::ifstream in(path, std::ios::binary);
+  unsigned char preamble[8];
+  if(!in.read(reinterpret_cast<char*>(preamble), sizeof(preamble))) return {};
+  if(preamble[0] != 0x93 || std::string(reinterpret_cast<char*>(preamble) + 1, 5) != "NUMPY") return {};
+  const unsigned major = preamble[6];
+  uint32_t header_len = 0;
+  if(major == 1) {
+    unsigned char len[2];
+    if(!in.read(reinterpret_cast<char*>(len), sizeof(len))) return {};
+    header_len = len[0] | (len[1] << 8);
+  } else if(major == 2 || major == 3) {
+    unsigned char len[4];
+    if(!in.read(reinterpret_cast<char*>(len), sizeof(len))) return {};
+    header_len = len[0] | (len[1] << 8) | (len[2] << 16) | (uint32_t(len[3]) << 24);
+  } else {
+    return {};
+  }
+  std::string header(header_len, '\0');
+  if(!in.read(&header[0], header_len)) return {};
+
+  if(npy_field(header, "fortran_order") != "False") return {};
+  auto dtype = npy_dtype(npy_field(header, "descr"));
+  if(!dtype) return {};
+  const std::string shape = npy_field(header, "shape");
+  if(shape.size() < 2) return {};
+
+  probed_metadata ret;
+  ret.dtype = *dtype;
+  size_t pos = 1;
+  while(pos < shape.size() - 1) {
+    const size_t begin = shape.find_first_of("0123456789", pos);
+    if(begin == std::string::npos || begin >= shape.size() - 1) break;
+    size_t end = shape.find_first_not_of("0123456789", begin);
+    ret.dims.push_back(std::stoull(shape.substr(begin, end - begin)));
+    pos = end;
+  }
+  //zero-dimensional arrays are left to the io plugin
+  if(ret.dims.empty()) return {};
+  return ret;
+}
+
+#if LIBPRESSIO_DATASET_HAS_HDF5
+/**
+ * read the dataspace and type of dataset in the HDF5 file at path
+ *
+ * \returns nothing if the file or dataset cannot be opened or has an unsupported type
+ */
+compat::optional<probed_metadata> probe_hdf5(std::string const& path, std::string const& dataset);
+#endif
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_IO_PROBE_H_W7RC2MQA */
@@ -0,0 +1,73 @@
+#ifndef LIBPRESSIO_DATASET_LAZY_H_R4TB9MXW
+#define LIBPRESSIO_DATASET_LAZY_H_R4TB9MXW
+#include <std_compat/optional.h>
+#include <atomic>
+#include <mutex>
+#include <utility>
+namespace libpressio_dataset {
+
+/**
+ * a value computed on first use that may be requested by several threads at once
+ *
+ * the first caller of get computes the value while concurrent callers wait for
+ * it.  If the computation throws, the next caller tries again.  Anything the
+ * computation writes besides the value is visible to every caller that get returns to.
+ *
+ * reset and assignment configure the value, so like set_options they may not
+ * be called concurrently with get.
+ */
+template <class T>
+class lazy {
+  public:
+    lazy()=default;
+    lazy(lazy const& rhs): value(rhs.value), ready(rhs.ready.load()) {}
+    lazy& operator=(lazy const& rhs) {
+      value = rhs.value;
+      ready = rhs.ready.load();
+      return *this;
+    }
+    lazy& operator=(T new_value) {
+      value = std::move(new_value);
+      ready = true;
+      return *this;
+    }
+
+    /**
+     * \returns the value, calling init to compute it if it is not yet known
+     */
+    template <class Init>
+    T const& get(Init&& init) {
+      if(!ready.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!ready.load(std::memory_order_relaxed)) {
+          value = init();
+          ready.store(true, std::memory_order_release);
+        }
+      }
+      return *value;
+    }
+
+    /**
+     * \returns the value if it is known, or nullptr otherwise
+     */
+    T const* get_if() const {
+      return ready.load(std::memory_order_acquire) ? &*value : nullptr;
+    }
+
+    void reset() {
+      ready = false;
+      value.reset();
+    }
+
+    explicit operator bool() const {
+      return ready.load(std::memory_order_acquire);
+    }
+
+  private:
+    compat::optional<T> value;
+    std::mutex mutex;
+    std::atomic<bool> ready{false};
+};
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_LAZY_H_R4TB9MXW */
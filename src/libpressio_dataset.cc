@@ -1,7 +1,15 @@
 #include "libpressio_dataset_ext/loader.h"
+#include "libpressio_dataset_ext/cursor.h"
 #include "libpressio_dataset_version.h"
 #include <cassert>
 #include <cstring>
+#include <numeric>
+
+namespace libpressio_dataset {
+    struct pressio_dataset_loader_request {
+        async_load load;
+    };
+}
 
 extern "C" {
 
@@ -122,8 +130,9 @@ int pressio_dataset_loader_load_all_metadata(struct pressio_dataset_loader* data
         auto ret = (*dataset_loader)->load_all_metadata();
         *metadata = new pressio_options*[ret.size()];
         for (size_t i = 0; i < ret.size(); ++i) {
-            *metadata[i] = new pressio_options(std::move(ret[i]));
+            (*metadata)[i] = new pressio_options(std::move(ret[i]));
         }
+        *n = ret.size();
         return 0;
     } catch(std::exception const& ex) {
         return (*dataset_loader)->set_error(1,ex.what());
@@ -138,8 +147,9 @@ int pressio_dataset_loader_load_all_data(struct pressio_dataset_loader* dataset_
         auto ret = (*dataset_loader)->load_all_data();
         *data = new pressio_data*[ret.size()];
         for (size_t i = 0; i < ret.size(); ++i) {
-            *data[i] = new pressio_data(std::move(ret[i]));
+            (*data)[i] = new pressio_data(std::move(ret[i]));
         }
+        *n = ret.size();
         return 0;
     } catch(std::exception const& ex) {
         return (*dataset_loader)->set_error(1,ex.what());
@@ -168,6 +178,106 @@ int pressio_dataset_loader_load_data(struct pressio_dataset_loader* dataset_load
         }
 }
 
+int pressio_dataset_loader_load_data_batch(struct pressio_dataset_loader* dataset_loader, size_t n_indices, size_t const* indices, struct pressio_data*** data) {
+    assert(dataset_loader && "loader cannot be null");
+    assert(data && "data cannot be null");
+    assert((indices || n_indices == 0) && "indices cannot be null");
+    try {
+        auto ret = (*dataset_loader)->load_data_batch(std::vector<size_t>(indices, indices + n_indices));
+        *data = new pressio_data*[ret.size()];
+        for (size_t i = 0; i < ret.size(); ++i) {
+            (*data)[i] = new pressio_data(std::move(ret[i]));
+        }
+        return 0;
+    } catch(std::exception const& ex) {
+        return (*dataset_loader)->set_error(1,ex.what());
+    }
+}
+
+int pressio_dataset_loader_load_metadata_batch(struct pressio_dataset_loader* dataset_loader, size_t n_indices, size_t const* indices, struct pressio_options*** metadata) {
+    assert(dataset_loader && "loader cannot be null");
+    assert(metadata && "metadata cannot be null");
+    assert((indices || n_indices == 0) && "indices cannot be null");
+    try {
+        auto ret = (*dataset_loader)->load_metadata_batch(std::vector<size_t>(indices, indices + n_indices));
+        *metadata = new pressio_options*[ret.size()];
+        for (size_t i = 0; i < ret.size(); ++i) {
+            (*metadata)[i] = new pressio_options(std::move(ret[i]));
+        }
+        return 0;
+    } catch(std::exception const& ex) {
+        return (*dataset_loader)->set_error(1,ex.what());
+    }
+}
+
+struct pressio_options* pressio_dataset_loader_get_metrics_results(struct pressio_dataset_loader const* dataset_loader) {
+    assert(dataset_loader && "loader cannot be null");
+    return new pressio_options((*dataset_loader)->get_metrics_results());
+}
+
+struct pressio_dataset_loader_cursor* pressio_dataset_loader_cursor_new(struct pressio_dataset_loader* dataset_loader, size_t n_indices, size_t const* indices, size_t depth) {
+    assert(dataset_loader && "loader cannot be null");
+    try {
+        std::vector<size_t> selected;
+        if(indices) {
+            selected.assign(indices, indices + n_indices);
+        } else {
+            selected.resize((*dataset_loader)->num_datasets());
+            std::iota(selected.begin(), selected.end(), 0);
+        }
+        return new pressio_dataset_loader_cursor(dataset_loader, std::move(selected), depth);
+    } catch(std::exception const& ex) {
+        (*dataset_loader)->set_error(1,ex.what());
+        return nullptr;
+    }
+}
+
+int pressio_dataset_loader_cursor_next(struct pressio_dataset_loader_cursor* cursor, size_t* index, struct pressio_data** data, struct pressio_options** metadata) {
+    assert(cursor && "cursor cannot be null");
+    assert(index && "index cannot be null");
+    assert(data && "data cannot be null");
+    assert(metadata && "metadata cannot be null");
+    try {
+        cursor_item item;
+        if(!cursor->cursor.next(item)) {
+            return -1;
+        }
+        *index = item.index;
+        *data = new pressio_data(std::move(item.data));
+        *metadata = new pressio_options(std::move(item.metadata));
+        return 0;
+    } catch(std::exception const& ex) {
+        return (*cursor->loader)->set_error(1,ex.what());
+    }
+}
+
+void pressio_dataset_loader_cursor_free(struct pressio_dataset_loader_cursor* cursor) {
+    if(cursor) delete cursor;
+}
+
+struct pressio_dataset_loader_request* pressio_dataset_loader_load_data_async(struct pressio_dataset_loader* dataset_loader, size_t n, void (*callback)(size_t, int, struct pressio_data*, const char*, void*), void* user_data) {
+    assert(dataset_loader && "loader cannot be null");
+    assert(callback && "callback cannot be null");
+    return new pressio_dataset_loader_request{(*dataset_loader)->load_data_async(n, [n, callback, user_data](std::future<pressio_data> result) {
+        try {
+            callback(n, 0, new pressio_data(result.get()), nullptr, user_data);
+        } catch(load_cancelled const&) {
+            callback(n, -1, nullptr, nullptr, user_data);
+        } catch(std::exception const& ex) {
+            callback(n, 1, nullptr, ex.what(), user_data);
+        }
+    })};
+}
+
+int pressio_dataset_loader_request_cancel(struct pressio_dataset_loader_request* request) {
+    assert(request && "request cannot be null");
+    return request->load.cancel() ? 0 : 1;
+}
+
+void pressio_dataset_loader_request_free(struct pressio_dataset_loader_request* request) {
+    if(request) delete request;
+}
+
 /*!
  * \returns the major version number of the library
  */
@@ -0,0 +1,85 @@
+#ifndef LIBPRESSIO_DATASET_PARENT_CACHE_H_Q8WD4LZN
+#define LIBPRESSIO_DATASET_PARENT_CACHE_H_Q8WD4LZN
+#include <libpressio_dataset_ext/loader.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+namespace libpressio_dataset {
+
+/**
+ * retains the most recently loaded parents of a loader that splits each
+ * parent into several datasets, so that consecutive requests for datasets from
+ * the same parent load it once.
+ *
+ * load may be called from several threads at once; parents are loaded without
+ * holding the lock, so threads that miss on the same parent at the same time
+ * may each load it.
+ *
+ * copies start empty so that clones do not duplicate the retained data.
+ */
+class parent_cache {
+  public:
+    parent_cache()=default;
+    parent_cache(parent_cache const& rhs): capacity(rhs.get_capacity()) {}
+    parent_cache& operator=(parent_cache const& rhs) {
+      set_capacity(rhs.get_capacity());
+      clear();
+      return *this;
+    }
+
+    /**
+     * \returns parent n, loading it from loader if it is not retained
+     */
+    std::shared_ptr<const pressio_data> load(dataset_loader& loader, size_t n) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+          if(it->first == n) {
+            entries.splice(entries.begin(), entries, it);
+            return entries.front().second;
+          }
+        }
+      }
+      auto loaded = std::make_shared<const pressio_data>(loader.load_data(n));
+      std::lock_guard<std::mutex> lock(mutex);
+      if(capacity == 0) return loaded;
+      for (auto const& entry : entries) {
+        if(entry.first == n) return entry.second;
+      }
+      //callers may still hold evicted parents, but the cache holds at most capacity
+      while(entries.size() >= capacity) {
+        entries.pop_back();
+      }
+      entries.emplace_front(n, loaded);
+      return loaded;
+    }
+
+    void set_capacity(size_t new_capacity) {
+      std::lock_guard<std::mutex> lock(mutex);
+      capacity = new_capacity;
+      while(entries.size() > capacity) {
+        entries.pop_back();
+      }
+    }
+    size_t get_capacity() const {
+      std::lock_guard<std::mutex> lock(mutex);
+      return capacity;
+    }
+
+    /**
+     * forget every retained parent; called whenever the parent loader may have changed
+     */
+    void clear() {
+      std::lock_guard<std::mutex> lock(mutex);
+      entries.clear();
+    }
+
+  private:
+    mutable std::mutex mutex;
+    size_t capacity = 1;
+    std::list<std::pair<size_t, std::shared_ptr<const pressio_data>>> entries;
+};
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_PARENT_CACHE_H_Q8WD4LZN */
@@ -1,10 +1,26 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <std_compat/memory.h>
+#include <parent_cache.h>
 #include <sstream>
 #include <random>
+#include <map>
+#include <mutex>
 namespace libpressio_dataset { namespace block_sampler_loader_ns {
 
   struct block_sampler_loader: public dataset_loader_base {
+    block_sampler_loader()=default;
+    block_sampler_loader(block_sampler_loader const& rhs):
+      dataset_loader_base(rhs),
+      seed(rhs.seed),
+      N(rhs.N),
+      block_size(rhs.block_size),
+      loader_id(rhs.loader_id),
+      loader(rhs.loader),
+      parents(rhs.parents)
+    {
+      std::lock_guard<std::mutex> lock(rhs.parent_dims_mutex);
+      parent_dims = rhs.parent_dims;
+    }
 
     size_t num_datasets_impl() override {
       return N * loader->num_datasets();
@@ -13,6 +29,13 @@ namespace libpressio_dataset { namespace block_sampler_loader_ns {
     int set_options_impl(pressio_options const& options) override {
       pressio_data new_block_size;
       get_meta(options, "block_sampler:loader", dataset_loader_plugins(), loader_id, loader);
+      //the child's configuration may have changed what its parents contain
+      parents.clear();
+      parent_dims.clear();
+      uint64_t new_parents = parents.get_capacity();
+      if(get(options, "block_sampler:parents", &new_parents) == pressio_options_key_set) {
+        parents.set_capacity(new_parents);
+      }
       if(get(options, "block_sampler:block_size", &new_block_size)==pressio_options_key_set) {
         block_size = new_block_size.to_vector<size_t>();
       }
@@ -24,6 +47,7 @@ namespace libpressio_dataset { namespace block_sampler_loader_ns {
     pressio_options get_options_impl() const override {
       pressio_options options;
       set_meta(options, "block_sampler:loader", loader_id, loader);
+      set(options, "block_sampler:parents", static_cast<uint64_t>(parents.get_capacity()));
       set(options, "block_sampler:block_size", pressio_data(block_size.begin(), block_size.end()));
       set(options, "block_sampler:n", N); set(options, "block_sampler:seed", seed);
       return options;
@@ -32,15 +56,47 @@ namespace libpressio_dataset { namespace block_sampler_loader_ns {
     pressio_options get_documentation_impl() const override {
       pressio_options options;
       set_meta_docs(options, "block_sampler:loader", "loader to sample from", loader);
+      set(options, "block_sampler:parents", "number of recently loaded parent datasets to keep in memory");
       set(options, "block_sampler:block_size", "block size to sample");
       set(options, "block_sampler:n", "number of samples to take from each data source");
       set(options, "block_sampler:seed", "seed");
       return options;
     }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
     
     pressio_data load_data_impl(size_t n) override {
-      pressio_data data = loader->load_data(n/N);
-      return sample(data, seed+n);
+      if(loader->supports_region()) {
+        return load_block(n/N, seed+n);
+      }
+      auto data = parents.load(*loader, n/N);
+      return sample(*data, seed+n);
+    }
+
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      if(loader->supports_region()) {
+        std::vector<pressio_data> ret;
+        ret.reserve(indices.size());
+        for (auto n : indices) {
+          ret.emplace_back(load_block(n/N, seed+n));
+        }
+        return ret;
+      }
+      //load each parent once no matter how many of its samples were requested
+      std::map<size_t, std::vector<size_t>> by_parent;
+      for (size_t i = 0; i < indices.size(); ++i) {
+        by_parent[indices[i] / N].emplace_back(i);
+      }
+      std::vector<pressio_data> ret(indices.size());
+      for (auto const& parent : by_parent) {
+        auto data = parents.load(*loader, parent.first);
+        for (auto i : parent.second) {
+          ret[i] = sample(*data, seed+indices[i]);
+        }
+      }
+      return ret;
     }
 
     pressio_options load_metadata_impl(size_t n) override {
@@ -52,24 +108,59 @@ namespace libpressio_dataset { namespace block_sampler_loader_ns {
       return metadata;
     }
 
-    pressio_data sample(pressio_data const& dat, size_t sample_seed) {
+    /**
+     * \returns the position in units of blocks of the block chosen by sample_seed within data with dimensions dat_dims
+     */
+    std::vector<size_t> block_index(std::vector<size_t> const& dat_dims, size_t sample_seed) const {
       std::seed_seq seed{sample_seed};
       std::mt19937 gen{seed};
+      std::vector<size_t> sampled_block(block_size.size());
+      for (size_t i = 0; i < block_size.size(); ++i) {
+        if(block_size[i] > dat_dims[i]) {
+          throw std::runtime_error("block_size must be smaller than data size");
+        }
+        size_t upper_bound = 
+          (dat_dims[i]%block_size[i] == 0) ? ((dat_dims[i]/block_size[i])-2):
+            (dat_dims[i]/block_size[i] - 1);
+        std::uniform_int_distribution<size_t> dist(0, upper_bound);
+        sampled_block[i] = dist(gen);
+      }
+      return sampled_block;
+    }
+
+    /**
+     * read only the block chosen by sample_seed from the child
+     */
+    pressio_data load_block(size_t parent, size_t sample_seed) {
+      std::vector<size_t> dims = get_parent_dims(parent);
+      if(dims.size() != block_size.size()) {
+        throw std::runtime_error("expected block ndims and data ndims to be the same");
+      }
+      std::vector<size_t> offset = block_index(dims, sample_seed);
+      for (size_t i = 0; i < offset.size(); ++i) {
+        offset[i] *= block_size[i];
+      }
+      return loader->load_region(parent, offset, block_size);
+    }
 
-      return pressio_data_for_each<pressio_data>(dat, [this, &dat, &gen](auto src, auto){
+    std::vector<size_t> get_parent_dims(size_t parent) {
+      {
+        std::lock_guard<std::mutex> lock(parent_dims_mutex);
+        auto it = parent_dims.find(parent);
+        if(it != parent_dims.end()) return it->second;
+      }
+      pressio_data dims;
+      loader->load_metadata(parent).get(loader->get_name(), "loader:dims", &dims);
+      std::lock_guard<std::mutex> lock(parent_dims_mutex);
+      return parent_dims.emplace(parent, dims.to_vector<size_t>()).first->second;
+    }
+
+    pressio_data sample(pressio_data const& dat, size_t sample_seed) {
+      trace::span span("copy", "block_sampler:copy");
+      return pressio_data_for_each<pressio_data>(dat, [this, &dat, sample_seed](auto src, auto){
           pressio_data sample = pressio_data::owning(dat.dtype(), block_size);
           std::vector<size_t> const& dat_dims = dat.dimensions();
-          std::vector<size_t> sampled_block(block_size.size());
-          for (size_t i = 0; i < block_size.size(); ++i) {
-            if(block_size[i] > dat_dims[i]) {
-              throw std::runtime_error("block_size must be smaller than data size");
-            }
-            size_t upper_bound = 
-              (dat_dims[i]%block_size[i] == 0) ? ((dat_dims[i]/block_size[i])-2):
-                (dat_dims[i]/block_size[i] - 1);
-            std::uniform_int_distribution<size_t> dist(0, upper_bound);
-            sampled_block[i] = dist(gen);
-          }
+          std::vector<size_t> sampled_block = block_index(dat_dims, sample_seed);
           using pointer = typename std::iterator_traits<decltype(src)>::pointer;
           pointer dst = static_cast<pointer>(sample.data());
 
@@ -162,6 +253,9 @@ namespace libpressio_dataset { namespace block_sampler_loader_ns {
     std::vector<size_t> block_size;
     std::string loader_id = "io_loader";
     pressio_dataset_loader loader = dataset_loader_plugins().build(loader_id);
+    parent_cache parents;
+    std::map<size_t, std::vector<size_t>> parent_dims;
+    mutable std::mutex parent_dims_mutex;
   };
 
   pressio_register block_sampler_loader_register(dataset_loader_plugins(), "block_sampler", []{ return compat::make_unique<block_sampler_loader>(); });
@@ -1,5 +1,8 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <std_compat/memory.h>
+#include <lazy.h>
+#include <parent_cache.h>
+#include <region.h>
 #include <std_compat/optional.h>
 #include <std_compat/numeric.h>
 #include <std_compat/functional.h>
@@ -8,56 +11,114 @@
 #include <iterator>
 #include <cmath>
 #include <functional>
+#include <map>
 namespace libpressio_dataset { namespace block_slicer_loader_ns {
 
   struct block_slicer_loader: public dataset_loader_base {
 
     size_t num_datasets_impl() override {
-      if(!N) {
-          set_n();
-      }
-      return *N * loader->num_datasets();
+      return blocks() * loader->num_datasets();
     }
 
     int set_options_impl(pressio_options const& options) override {
       pressio_data new_block_size;
       get_meta(options, "block_slicer:loader", dataset_loader_plugins(), loader_id, loader);
+      //the child's configuration may have changed what its parents contain
+      parents.clear();
+      N.reset();
+      uint64_t new_parents = parents.get_capacity();
+      if(get(options, "block_slicer:parents", &new_parents) == pressio_options_key_set) {
+        parents.set_capacity(new_parents);
+      }
       if(get(options, "block_slicer:block_size", &new_block_size)==pressio_options_key_set) {
         block_size = new_block_size.to_vector<size_t>();
       }
+      get(options, "block_slicer:chunked", &chunked);
       return 0;
     }
 
     pressio_options get_options_impl() const override {
       pressio_options options;
       set_meta(options, "block_slicer:loader", loader_id, loader);
+      set(options, "block_slicer:parents", static_cast<uint64_t>(parents.get_capacity()));
       set(options, "block_slicer:block_size", pressio_data(block_size.begin(), block_size.end()));
+      set(options, "block_slicer:chunked", chunked);
       return options;
     }
 
     pressio_options get_documentation_impl() const override {
       pressio_options options;
       set_meta_docs(options, "block_slicer:loader", "loader to sample from", loader);
+      set(options, "block_slicer:parents", "number of recently loaded parent datasets to keep in memory");
       set(options, "block_slicer:block_size", "block size to sample");
+      set(options, "block_slicer:chunked", "use the child's loader:chunks instead of block_slicer:block_size so each block is one stored chunk; blocks at the edges may be smaller, and every parent must have the dims and chunks of the first");
       return options;
     }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
     
     pressio_data load_data_impl(size_t n) override {
-      if(!N) set_n();
-      pressio_data data = loader->load_data(n/ *N);
-      return sample(data, n % *N);
+      const size_t nblocks = blocks();
+      if(loader->supports_region()) {
+        return load_block(n / nblocks, n % nblocks);
+      }
+      auto data = parents.load(*loader, n / nblocks);
+      if(chunked) {
+        check_grid(n / nblocks, loader->load_metadata(n / nblocks));
+        return copy_chunk(*data, n % nblocks);
+      }
+      return sample(*data, n % nblocks);
+    }
+
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      const size_t nblocks = blocks();
+      if(loader->supports_region()) {
+        std::vector<pressio_data> ret;
+        ret.reserve(indices.size());
+        for (auto n : indices) {
+          ret.emplace_back(load_block(n / nblocks, n % nblocks));
+        }
+        return ret;
+      }
+      //load each parent once no matter how many of its blocks were requested
+      std::map<size_t, std::vector<size_t>> by_parent;
+      for (size_t i = 0; i < indices.size(); ++i) {
+        by_parent[indices[i] / nblocks].emplace_back(i);
+      }
+      std::vector<pressio_data> ret(indices.size());
+      for (auto const& parent : by_parent) {
+        auto data = parents.load(*loader, parent.first);
+        if(chunked) check_grid(parent.first, loader->load_metadata(parent.first));
+        for (auto i : parent.second) {
+          ret[i] = chunked ? copy_chunk(*data, indices[i] % nblocks) : sample(*data, indices[i] % nblocks);
+        }
+      }
+      return ret;
     }
 
     pressio_options load_metadata_impl(size_t n) override {
-      if(!N) set_n();
-      pressio_options metadata = loader->load_metadata(n / *N);
+      const size_t nblocks = blocks();
+      pressio_options metadata = loader->load_metadata(n / nblocks);
       pressio_dtype dtype = pressio_byte_dtype;
       metadata.get(loader->get_name(), "loader:dtype", &dtype);
-      set(metadata, "loader:dims", pressio_data(block_size.begin(), block_size.end()));
+      if(chunked) {
+        check_grid(n / nblocks, metadata);
+        std::vector<size_t> offset, count;
+        block_extent(parent_dims, n % nblocks, offset, count);
+        set(metadata, "loader:dims", pressio_data(count.begin(), count.end()));
+      } else {
+        set(metadata, "loader:dims", pressio_data(block_size.begin(), block_size.end()));
+      }
       set(metadata, "loader:dtype", dtype);
       return metadata;
     }
 
+    void set_name_impl(std::string const& new_name) override {
+      loader->set_name(new_name + "/" + loader->prefix());
+    }
+
     std::unique_ptr<dataset_loader> clone() override {
             return std::make_unique<block_slicer_loader>(*this);
     }
@@ -77,35 +138,80 @@ namespace libpressio_dataset { namespace block_slicer_loader_ns {
     }
       private:
 
+    /**
+     * \returns the position in units of blocks of block number idx within data with dimensions dat_dims
+     */
+    std::vector<size_t> block_index(std::vector<size_t> const& dat_dims, size_t idx) const {
+      std::vector<size_t> const& shape = block_shape();
+      if(shape.size() != dat_dims.size()) {
+        throw std::runtime_error("expected block ndims and data ndims to be the same");
+      }
+
+      std::vector<size_t> n_blocks(dat_dims.size());
+      for (size_t i = 0; i < dat_dims.size(); ++i) {
+         if(chunked) {
+           //edge chunks are partial
+           n_blocks[i] = (dat_dims[i] + shape[i] - 1)/shape[i];
+           continue;
+         }
+         if(dat_dims[i] % shape[i] != 0) {
+            throw std::runtime_error("for now, data dims need to be a multiple of block size");
+         }
+         n_blocks[i] = dat_dims[i]/shape[i];
+      }
+      std::vector<size_t> sampled_block(shape.size());
+      std::vector<size_t> strides;
+      compat::exclusive_scan(
+              n_blocks.begin(),
+              n_blocks.end(),
+              std::back_inserter(strides),
+              size_t{1},
+              compat::multiplies<>{});
+      const size_t l = dat_dims.size()-1;
+      for (size_t i = 0; i < dat_dims.size(); ++i) {
+        sampled_block[l-i] = idx / strides[l-i];
+        idx %= strides[l-i];
+      }
+      return sampled_block;
+    }
+
+    /**
+     * compute the first element and size of block number block within data with dimensions dat_dims
+     *
+     * blocks at the upper edges are truncated to fit
+     */
+    void block_extent(std::vector<size_t> const& dat_dims, size_t block, std::vector<size_t>& offset, std::vector<size_t>& count) const {
+      std::vector<size_t> const& shape = block_shape();
+      offset = block_index(dat_dims, block);
+      count.resize(offset.size());
+      for (size_t i = 0; i < offset.size(); ++i) {
+        offset[i] *= shape[i];
+        count[i] = std::min(shape[i], dat_dims[i] - offset[i]);
+      }
+    }
+
+    /**
+     * read only block number block of parent from the child
+     */
+    pressio_data load_block(size_t parent, size_t block) {
+      if(chunked) check_grid(parent, loader->load_metadata(parent));
+      std::vector<size_t> offset, count;
+      block_extent(parent_dims, block, offset, count);
+      return loader->load_region(parent, offset, count);
+    }
+
+    pressio_data copy_chunk(pressio_data const& dat, size_t block) const {
+      std::vector<size_t> offset, count;
+      block_extent(dat.dimensions(), block, offset, count);
+      trace::span span("copy", "block_slicer:copy");
+      return copy_region(dat, offset, count);
+    }
+
     pressio_data sample(pressio_data const& dat, size_t sample_seed) {
       return pressio_data_for_each<pressio_data>(dat, [this, &dat, sample_seed](auto src, auto){
           pressio_data sample = pressio_data::owning(dat.dtype(), block_size);
           std::vector<size_t> const& dat_dims = dat.dimensions();
-          if(block_size.size() != dat_dims.size()) {
-            throw std::runtime_error("expected block ndims and data ndims to be the same");
-          }
-
-          std::vector<size_t> n_blocks(dat_dims.size());
-          for (size_t i = 0; i < dat_dims.size(); ++i) {
-             if(dat_dims[i] % block_size[i] != 0) {
-                throw std::runtime_error("for now, data dims need to be a multiple of block size");
-             }
-             n_blocks[i] = dat_dims[i]/block_size[i];
-          }
-          std::vector<size_t> sampled_block(block_size.size());
-          std::vector<size_t> strides;
-          size_t idx  = sample_seed;
-          compat::exclusive_scan(
-                  n_blocks.begin(),
-                  n_blocks.end(),
-                  std::back_inserter(strides),
-                  size_t{1},
-                  compat::multiplies<>{});
-          const size_t l = dat_dims.size()-1;
-          for (size_t i = 0; i < dat_dims.size(); ++i) {
-            sampled_block[l-i] = idx / strides[l-i];
-            idx %= strides[l-i];
-          }
+          std::vector<size_t> sampled_block = block_index(dat_dims, sample_seed);
 
           using pointer = typename std::iterator_traits<decltype(src)>::pointer;
           pointer dst = static_cast<pointer>(sample.data());
@@ -171,21 +277,65 @@ namespace libpressio_dataset { namespace block_slicer_loader_ns {
           return sample;
       });
     }
-    void set_n() {
+    /**
+     * \returns the size of each block: the child's chunks when chunked, otherwise block_slicer:block_size
+     */
+    std::vector<size_t> const& block_shape() const {
+      return chunked ? chunk_shape : block_size;
+    }
+
+    /**
+     * every parent is divided into the same blocks as parent 0, so when chunked
+     * each parent must share its dims and chunks
+     */
+    void check_grid(size_t parent, pressio_options const& metadata) const {
+      pressio_data dims, chunks;
+      metadata.get(loader->get_name(), "loader:dims", &dims);
+      metadata.get(loader->get_name(), "loader:chunks", &chunks);
+      if(dims.to_vector<size_t>() != parent_dims || chunks.to_vector<size_t>() != chunk_shape) {
+        throw std::runtime_error("block_slicer:chunked requires every parent to have the dims and loader:chunks of parent 0, but parent " + std::to_string(parent) + " differs");
+      }
+    }
+
+    /**
+     * \returns the number of blocks in each parent
+     *
+     * parent_dims, and chunk_shape when chunked, are filled in along with the count
+     */
+    size_t blocks() {
+      return N.get([this]{ return count_blocks(); });
+    }
+
+    size_t count_blocks() {
       pressio_options metadata = loader->load_metadata(0);
       pressio_data dims;
       metadata.get(loader->get_name(), "loader:dims", &dims);
-      std::vector<size_t> data_dims = dims.to_vector<size_t>();
-      *N = 1;
-      for (size_t i = 0; i < std::min(data_dims.size(), block_size.size()); ++i) {
-          *N *= (size_t)std::ceil(data_dims[i]/(double)block_size[i]);
+      parent_dims = dims.to_vector<size_t>();
+      if(chunked) {
+        pressio_data chunks;
+        metadata.get(loader->get_name(), "loader:chunks", &chunks);
+        if(chunks.num_elements() == 0) {
+          throw std::runtime_error("block_slicer:chunked requires a child that reports loader:chunks");
+        }
+        chunk_shape = chunks.to_vector<size_t>();
+      }
+      std::vector<size_t> const& shape = block_shape();
+      size_t blocks = 1;
+      for (size_t i = 0; i < std::min(parent_dims.size(), shape.size()); ++i) {
+          blocks *= (size_t)std::ceil(parent_dims[i]/(double)shape[i]);
       }
+      return blocks;
     }
 
-    compat::optional<size_t> N;
+    lazy<size_t> N;
+    std::vector<size_t> parent_dims;
     std::vector<size_t> block_size;
+    /** parent 0's loader:chunks, used instead of block_size when chunked */
+    std::vector<size_t> chunk_shape;
+    bool chunked = false;
     std::string loader_id = "io_loader";
     pressio_dataset_loader loader = dataset_loader_plugins().build(loader_id);
+    parent_cache parents;
   };
 
   pressio_register block_slicer_loader_register(dataset_loader_plugins(), "block_slicer", []{ return compat::make_unique<block_slicer_loader>(); });
@@ -1,18 +1,139 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <std_compat/memory.h>
+#include <cache_policy.h>
+#include <disk_cache.h>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 namespace libpressio_dataset { namespace cache_loader_ns {
+
+  /**
+   * a load of one index from the child that other requests for the same index wait on
+   */
+  struct flight {
+    flight(): result(promise.get_future().share()) {}
+    std::promise<pressio_data> promise;
+    std::shared_future<pressio_data> result;
+    size_t waiters = 0;
+  };
+
+  /**
+   * one independently locked part of the cache's storage; index n lives in shard n % shards
+   */
+  struct cache_shard {
+    std::mutex mutex;
+    std::unordered_map<size_t, pressio_data> data;
+    std::unordered_map<size_t, std::shared_ptr<flight>> inflight;
+    std::atomic<size_t> bytes{0};
+  };
+
+  /**
+   * everything shared between a cache_loader and its clones
+   *
+   * only the storage is sharded; one policy sees every access so that it alone decides
+   * what to evict.  When both locks are needed, policy_mutex is taken before a shard's mutex.
+   */
+  struct cache_state {
+    cache_state(size_t nshards, std::string const& policy_name, size_t max_bytes, std::unique_ptr<disk_cache>&& disk):
+      shards(std::max<size_t>(nshards, 1)),
+      policy(make_cache_policy(policy_name, max_bytes)),
+      disk(std::move(disk))
+    {}
+    cache_shard& shard(size_t n) {
+      return shards[n % shards.size()];
+    }
+
+    std::vector<cache_shard> shards;
+    std::mutex policy_mutex;
+    std::unique_ptr<cache_policy> policy;
+    std::unique_ptr<disk_cache> disk;
+
+    std::mutex metadata_mutex;
+    std::optional<size_t> num_datasets;
+    std::map<size_t,pressio_options> metadata;
+
+    std::atomic<uint64_t> resident_bytes{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> disk_hits{0};
+    std::atomic<uint64_t> disk_writes{0};
+  };
+
   struct cache_loader: public dataset_loader_base {
+    cache_loader()=default;
+    /**
+     * clones share the cached entries so that threads using their own clone still share one cache
+     */
+    cache_loader(cache_loader const& rhs):
+      dataset_loader_base(rhs),
+      loader_id(rhs.loader_id),
+      loader(rhs.loader),
+      max_bytes(rhs.max_bytes),
+      policy_name(rhs.policy_name),
+      disk_dir(rhs.disk_dir),
+      shards(rhs.shards),
+      state(rhs.state)
+    {}
 
     size_t num_datasets_impl() override {
-      if(!num_datasets_cache) {
-        num_datasets_cache = loader->num_datasets();
+      std::lock_guard<std::mutex> lock(state->metadata_mutex);
+      if(!state->num_datasets) {
+        state->num_datasets = loader->num_datasets();
       }
-      return *num_datasets_cache;
+      return *state->num_datasets;
     }
 
     int set_options_impl(pressio_options const& options) override {
+      const uint64_t old_hash = configuration_hash(loader_id, loader->get_options());
       get_meta(options, "cache:loader", dataset_loader_plugins(), loader_id, loader);
+      const uint64_t new_hash = configuration_hash(loader_id, loader->get_options());
+      bool fresh = old_hash != new_hash;
+      std::string new_disk_dir = disk_dir;
+      if(get(options, "cache:disk_dir", &new_disk_dir) == pressio_options_key_set && new_disk_dir != disk_dir) {
+        disk_dir = std::move(new_disk_dir);
+        fresh = true;
+      }
+      uint64_t new_shards = shards;
+      if(get(options, "cache:shards", &new_shards) == pressio_options_key_set && new_shards != shards) {
+        if(new_shards == 0) return set_error(1, "cache:shards must be at least 1");
+        shards = new_shards;
+        fresh = true;
+      }
+      std::string new_policy = policy_name;
+      if(get(options, "cache:policy", &new_policy) == pressio_options_key_set && new_policy != policy_name) {
+        try {
+          make_cache_policy(new_policy, max_bytes);
+        } catch(std::exception const& ex) {
+          return set_error(1, ex.what());
+        }
+        policy_name = std::move(new_policy);
+        if(!fresh) rebuild_policy();
+      }
+      uint64_t new_max_bytes = max_bytes;
+      if(get(options, "cache:max_bytes", &new_max_bytes) == pressio_options_key_set && new_max_bytes != max_bytes) {
+        max_bytes = new_max_bytes;
+        if(!fresh) {
+          rebuild_policy();
+          make_room(0);
+        }
+      }
+      if(fresh) {
+        //entries loaded with the child's old configuration must not be returned,
+        //but clones that still use the old configuration may keep sharing them
+        std::unique_ptr<disk_cache> disk;
+        if(!disk_dir.empty()) {
+          //entries are stored under a hash of the child's configuration so that
+          //differently configured loaders never share entries
+          disk = std::make_unique<disk_cache>(disk_cache_dir(disk_dir, new_hash));
+        }
+        state = std::make_shared<cache_state>(shards, policy_name, max_bytes, std::move(disk));
+      }
       bool reset = false;
       if(get(options, "cache:flush", &reset) == pressio_options_key_set) {
         reset_cache();
@@ -24,6 +145,17 @@ namespace libpressio_dataset { namespace cache_loader_ns {
       pressio_options options;
       set_meta(options, "cache:loader", loader_id, loader);
       set_type(options, "cache:flush", pressio_option_bool_type);
+      set(options, "cache:max_bytes", max_bytes);
+      set(options, "cache:policy", policy_name);
+      set(options, "cache:shards", shards);
+      set(options, "cache:hits", state->hits.load());
+      set(options, "cache:misses", state->misses.load());
+      set(options, "cache:coalesced", state->coalesced.load());
+      set(options, "cache:evictions", state->evictions.load());
+      set(options, "cache:resident_bytes", state->resident_bytes.load());
+      set(options, "cache:disk_dir", disk_dir);
+      set(options, "cache:disk_hits", state->disk_hits.load());
+      set(options, "cache:disk_writes", state->disk_writes.load());
       return options;
     }
 
@@ -31,29 +163,131 @@ namespace libpressio_dataset { namespace cache_loader_ns {
       pressio_options options;
       set_meta_docs(options, "cache:loader", "plugin to use for cache", loader);
       set(options, "cache:flush", "flush the cache");
+      set(options, "cache:max_bytes", "maximum number of bytes of data to keep; 0 means unbounded");
+      set(options, "cache:policy", "eviction policy used once cache:max_bytes is reached: lru, lfu, or arc");
+      set(options, "cache:shards", "number of independently locked parts of the cache; more shards reduce contention between threads");
+      set(options, "cache:hits", "number of data loads served from the cache");
+      set(options, "cache:misses", "number of data loads forwarded to the child loader");
+      set(options, "cache:coalesced", "number of data loads that waited on a concurrent miss for the same index");
+      set(options, "cache:evictions", "number of entries evicted to stay under cache:max_bytes");
+      set(options, "cache:resident_bytes", "number of bytes of data currently cached");
+      set(options, "cache:disk_dir", "if set, directory to persist loaded data to and map it back from on later runs");
+      set(options, "cache:disk_hits", "number of data loads served from cache:disk_dir");
+      set(options, "cache:disk_writes", "number of entries written to cache:disk_dir");
       return options;
     }
-    
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
+
     pressio_data load_data_impl(size_t n) override {
-      auto it = data_cache.find(n);
-      if(it == data_cache.end()) {
-        data_cache[n] = loader->load_data(n);
+      pressio_data data;
+      std::shared_ptr<flight> f;
+      switch(claim(n, data, f)) {
+        case claim_status::hit:
+          return data;
+        case claim_status::waiting:
+          return f->result.get();
+        case claim_status::leader:
+          break;
+      }
+      bool from_disk = false;
+      try {
+        if(auto mapped = disk_load(n)) {
+          data = std::move(*mapped);
+          from_disk = true;
+        } else {
+          data = loader->load_data(n);
+        }
+      } catch(...) {
+        abandon(n, f, std::current_exception());
+        throw;
+      }
+      if(!from_disk) {
+        store(n, data);
+        disk_store(n, data);
+      }
+      complete(n, f, data);
+      return data;
+    }
+
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      std::vector<pressio_data> ret(indices.size());
+      std::vector<std::shared_ptr<flight>> waits(indices.size());
+      std::vector<size_t> leading_idx;
+      std::vector<size_t> leading_pos;
+      std::vector<std::shared_ptr<flight>> leading;
+      for (size_t i = 0; i < indices.size(); ++i) {
+        std::shared_ptr<flight> f;
+        switch(claim(indices[i], ret[i], f)) {
+          case claim_status::hit:
+            break;
+          case claim_status::waiting:
+            //includes repeated indices within this batch, which this call resolves below
+            waits[i] = std::move(f);
+            break;
+          case claim_status::leader:
+            leading_idx.emplace_back(indices[i]);
+            leading_pos.emplace_back(i);
+            leading.emplace_back(std::move(f));
+            break;
+        }
+      }
+
+      //forward only the misses so the child can batch them
+      try {
+        std::vector<size_t> child_idx;
+        std::vector<size_t> child_pos;
+        for (size_t i = 0; i < leading_idx.size(); ++i) {
+          if(auto mapped = disk_load(leading_idx[i])) {
+            complete(leading_idx[i], leading[i], *mapped);
+            leading[i].reset();
+            ret[leading_pos[i]] = std::move(*mapped);
+          } else {
+            child_idx.emplace_back(leading_idx[i]);
+            child_pos.emplace_back(i);
+          }
+        }
+        if(!child_idx.empty()) {
+          std::vector<pressio_data> loaded = loader->load_data_batch(child_idx);
+          for (size_t i = 0; i < child_idx.size(); ++i) {
+            store(child_idx[i], loaded[i]);
+            disk_store(child_idx[i], loaded[i]);
+            complete(child_idx[i], leading[child_pos[i]], loaded[i]);
+            leading[child_pos[i]].reset();
+            ret[leading_pos[child_pos[i]]] = std::move(loaded[i]);
+          }
+        }
+      } catch(...) {
+        for (size_t i = 0; i < leading.size(); ++i) {
+          if(leading[i]) abandon(leading_idx[i], leading[i], std::current_exception());
+        }
+        throw;
+      }
+
+      //every index this call led is complete, so these waits cannot depend on this call
+      for (size_t i = 0; i < indices.size(); ++i) {
+        if(waits[i]) ret[i] = waits[i]->result.get();
       }
-      return data_cache[n];
+      return ret;
     }
 
     pressio_options load_metadata_impl(size_t n) override {
-      auto it = metadata_cache.find(n);
-      if(it == metadata_cache.end()) {
-        metadata_cache[n] = loader->load_metadata(n);
-        pressio_data dims;
-        pressio_dtype dtype;
-        metadata_cache[n].get(loader->get_name(), "loader:dims", &dims);
-        metadata_cache[n].get(loader->get_name(), "loader:dtype", &dtype);
-        set(metadata_cache[n], "loader:dims", dims);
-        set(metadata_cache[n], "loader:dtype", dtype);
+      {
+        std::lock_guard<std::mutex> lock(state->metadata_mutex);
+        auto it = state->metadata.find(n);
+        if(it != state->metadata.end()) return it->second;
       }
-      return metadata_cache[n];
+      pressio_options metadata = loader->load_metadata(n);
+      pressio_data dims;
+      pressio_dtype dtype;
+      metadata.get(loader->get_name(), "loader:dims", &dims);
+      metadata.get(loader->get_name(), "loader:dtype", &dtype);
+      set(metadata, "loader:dims", dims);
+      set(metadata, "loader:dtype", dtype);
+      std::lock_guard<std::mutex> lock(state->metadata_mutex);
+      return state->metadata.emplace(n, std::move(metadata)).first->second;
     }
 
     std::unique_ptr<dataset_loader> clone() override {
@@ -61,9 +295,18 @@ namespace libpressio_dataset { namespace cache_loader_ns {
     }
 
     void reset_cache() {
-      num_datasets_cache.reset();
-      metadata_cache.clear();
-      data_cache.clear();
+      {
+        std::lock_guard<std::mutex> lock(state->metadata_mutex);
+        state->num_datasets.reset();
+        state->metadata.clear();
+      }
+      std::lock_guard<std::mutex> policy_lock(state->policy_mutex);
+      state->policy->clear();
+      for (auto& shard : state->shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.data.clear();
+        state->resident_bytes -= shard.bytes.exchange(0);
+      }
     }
 
     const char* prefix() const override {
@@ -84,12 +327,163 @@ namespace libpressio_dataset { namespace cache_loader_ns {
       loader->set_name(new_name + "/" + loader->prefix());
     }
 
+    private:
+    enum class claim_status { hit, waiting, leader };
+
+    /**
+     * look up index n
+     *
+     * on a hit, data holds a copy of the entry.  Otherwise f is the load of n that
+     * the caller must either wait on or, as the leader, perform and then complete or abandon.
+     */
+    claim_status claim(size_t n, pressio_data& data, std::shared_ptr<flight>& f) {
+      cache_shard& shard = state->shard(n);
+      std::unique_lock<std::mutex> lock(shard.mutex);
+      auto it = shard.data.find(n);
+      if(it != shard.data.end()) {
+        ++state->hits;
+        trace::instant("cache", "cache:hit", "\"index\":" + std::to_string(n));
+        data = it->second;
+        //the policy lock is taken before shard locks, so record the hit after releasing this one;
+        //if n was evicted in the meantime the policy ignores the hit
+        lock.unlock();
+        std::lock_guard<std::mutex> policy_lock(state->policy_mutex);
+        state->policy->hit(n);
+        return claim_status::hit;
+      }
+      auto pending = shard.inflight.find(n);
+      if(pending != shard.inflight.end()) {
+        ++state->coalesced;
+        ++pending->second->waiters;
+        f = pending->second;
+        return claim_status::waiting;
+      }
+      ++state->misses;
+      trace::instant("cache", "cache:miss", "\"index\":" + std::to_string(n));
+      f = std::make_shared<flight>();
+      shard.inflight.emplace(n, f);
+      return claim_status::leader;
+    }
+
+    /**
+     * publish the result of a load led by this thread to any waiters
+     */
+    void complete(size_t n, std::shared_ptr<flight> const& f, pressio_data const& data) {
+      if(finish(n, f)) f->promise.set_value(data);
+    }
+
+    void abandon(size_t n, std::shared_ptr<flight> const& f, std::exception_ptr error) {
+      if(finish(n, f)) f->promise.set_exception(error);
+    }
+
+    /**
+     * \returns true if another request is waiting on f
+     */
+    bool finish(size_t n, std::shared_ptr<flight> const& f) {
+      cache_shard& shard = state->shard(n);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.inflight.erase(n);
+      return f->waiters != 0;
+    }
+
+    /**
+     * cache a copy of data for index n, evicting other entries as needed to stay within max_bytes
+     */
+    void store(size_t n, pressio_data const& data) {
+      const size_t bytes = data.size_in_bytes();
+      if(max_bytes != 0 && bytes > max_bytes) return;
+      cache_shard& shard = state->shard(n);
+      {
+        std::lock_guard<std::mutex> policy_lock(state->policy_mutex);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if(shard.data.find(n) != shard.data.end()) return;
+        state->policy->admit(n, bytes);
+      }
+      //reserve the space first so that concurrent stores account for each other
+      state->resident_bytes += bytes;
+      make_room(0);
+      std::lock_guard<std::mutex> policy_lock(state->policy_mutex);
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if(!shard.data.emplace(n, data).second) {
+        state->resident_bytes -= bytes;
+        return;
+      }
+      state->policy->insert(n, bytes);
+      shard.bytes += bytes;
+    }
+
+    /**
+     * \returns the entry for n mapped from cache:disk_dir if it was persisted by this or an earlier run
+     */
+    compat::optional<pressio_data> disk_load(size_t n) {
+      if(!state->disk) return {};
+      auto mapped = state->disk->load(n);
+      if(mapped) {
+        ++state->disk_hits;
+        trace::instant("cache", "cache:disk_hit", "\"index\":" + std::to_string(n));
+      }
+      return mapped;
+    }
+
+    void disk_store(size_t n, pressio_data const& data) {
+      if(!state->disk) return;
+      if(state->disk->store(n, data)) ++state->disk_writes;
+    }
+
+    /**
+     * evict the entries chosen by the policy until there is space for another bytes
+     *
+     * only the shard holding the current victim is locked while it is removed
+     */
+    void make_room(size_t bytes) {
+      if(max_bytes == 0) return;
+      std::lock_guard<std::mutex> policy_lock(state->policy_mutex);
+      while(state->resident_bytes + bytes > max_bytes) {
+        bool empty = true;
+        for (auto& shard : state->shards) {
+          if(shard.bytes != 0) {
+            empty = false;
+            break;
+          }
+        }
+        //the remaining bytes are reserved by stores that have not inserted yet
+        if(empty) break;
+        const size_t victim = state->policy->victim();
+        cache_shard& shard = state->shard(victim);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.data.find(victim);
+        const size_t victim_bytes = it->second.size_in_bytes();
+        shard.data.erase(it);
+        state->policy->erase(victim);
+        shard.bytes -= victim_bytes;
+        state->resident_bytes -= victim_bytes;
+        ++state->evictions;
+      }
+    }
+
+    /**
+     * replace the policy, preserving which entries are resident
+     */
+    void rebuild_policy() {
+      auto new_policy = make_cache_policy(policy_name, max_bytes);
+      std::lock_guard<std::mutex> policy_lock(state->policy_mutex);
+      for (auto& shard : state->shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto const& entry : shard.data) {
+          new_policy->insert(entry.first, entry.second.size_in_bytes());
+        }
+      }
+      state->policy = std::move(new_policy);
+    }
+
     std::string loader_id = "io_loader";
     pressio_dataset_loader loader = dataset_loader_plugins().build(loader_id);
+    uint64_t max_bytes = 0;
+    std::string policy_name = "lru";
+    std::string disk_dir;
+    uint64_t shards = 16;
 
-    std::optional<size_t> num_datasets_cache;
-    std::map<size_t,pressio_options> metadata_cache;
-    std::map<size_t,pressio_data> data_cache;
+    std::shared_ptr<cache_state> state = std::make_shared<cache_state>(shards, policy_name, max_bytes, nullptr);
   };
 
   pressio_register cache_loader_register(dataset_loader_plugins(), "cache", []{ return compat::make_unique<cache_loader>(); });
@@ -1,19 +1,76 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <std_compat/memory.h>
+#include <async_reader.h>
+#include <clone_pool.h>
+#include <disk_cache.h>
+#include <folder_manifest.h>
+#include <lazy.h>
 #include <sstream>
 #include <regex>
 #include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 namespace libpressio_dataset { namespace folder_loader_ns {
   namespace fs = std::filesystem;
+
+  /**
+   * reads issued ahead of the requests to a folder in async mode
+   *
+   * copies start empty so that clones issue their own reads
+   */
+  struct async_window {
+    async_window()=default;
+    async_window(async_window const&) {}
+    async_window& operator=(async_window const&) {
+      reset();
+      return *this;
+    }
+    void reset() {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.clear();
+      reader.reset();
+    }
+
+    std::mutex mutex;
+    std::unique_ptr<async_reader> reader;
+    std::map<size_t, std::future<pressio_data>> pending;
+  };
+
   struct folder_loader: public dataset_loader_base {
 
     size_t num_datasets_impl() override {
-      if(!paths) scan();
-      return paths->size();
+      return get_paths().size();
     }
 
     int set_options_impl(pressio_options const& options) override {
       get_meta(options, "folder:plugin", dataset_loader_plugins(), loader_plugin_id, loader_plugin);
+      children.clear();
+      //outstanding reads may be for paths or layouts that are about to change
+      window.reset();
+      std::string new_io_mode = io_mode;
+      if(get(options, "folder:io_mode", &new_io_mode) == pressio_options_key_set) {
+        if(new_io_mode != "loader" && new_io_mode != "async") {
+          return set_error(1, "unsupported folder:io_mode " + new_io_mode);
+        }
+        io_mode = std::move(new_io_mode);
+      }
+      std::string new_backend = async_backend;
+      if(get(options, "folder:async_backend", &new_backend) == pressio_options_key_set) {
+        if(new_backend != "auto" && new_backend != "io_uring" && new_backend != "pread") {
+          return set_error(1, "unsupported folder:async_backend " + new_backend);
+        }
+        async_backend = std::move(new_backend);
+      }
+      get(options, "folder:queue_depth", &queue_depth);
+      get(options, "folder:direct", &direct);
       bool new_recursive = recursive;
       if(get(options, "folder:recursive", &new_recursive) == pressio_options_key_set && new_recursive != recursive) {
         recursive = new_recursive;
@@ -32,7 +89,17 @@ namespace libpressio_dataset { namespace folder_loader_ns {
 
       //no need to reset here, this can't change the search results, just metadata
       get(options, "folder:groups", &groups);
-      get(options, "folder:paths", &paths);
+      get(options, "folder:scan_threads", &scan_threads);
+      std::string new_manifest_path = manifest_path;
+      if(get(options, "folder:manifest", &new_manifest_path) == pressio_options_key_set && new_manifest_path != manifest_path) {
+        manifest_path = std::move(new_manifest_path);
+        manifest = manifest_path.empty() ? nullptr : std::make_shared<folder_manifest>(manifest_path);
+      }
+      child_hash.reset();
+      std::vector<std::string> new_paths;
+      if(get(options, "folder:paths", &new_paths) == pressio_options_key_set) {
+        paths = std::move(new_paths);
+      }
 
       //provide a way to force a re-scan
       bool tmp;
@@ -49,7 +116,17 @@ namespace libpressio_dataset { namespace folder_loader_ns {
       set(options, "folder:regex", rgx);
       set(options, "folder:base_dir", base_dir);
       set(options, "folder:groups", groups);
-      set(options, "folder:paths", paths);
+      if(auto found = paths.get_if()) {
+        set(options, "folder:paths", *found);
+      } else {
+        set_type(options, "folder:paths", pressio_option_charptr_array_type);
+      }
+      set(options, "folder:scan_threads", scan_threads);
+      set(options, "folder:manifest", manifest_path);
+      set(options, "folder:io_mode", io_mode);
+      set(options, "folder:async_backend", async_backend);
+      set(options, "folder:queue_depth", queue_depth);
+      set(options, "folder:direct", direct);
       set_type(options, "folder:rescan", pressio_option_bool_type);
       return options;
     }
@@ -62,68 +139,395 @@ namespace libpressio_dataset { namespace folder_loader_ns {
       set(options, "folder:base_dir", "base directory for the search");
       set(options, "folder:groups", "names for match expresison in the regex");
       set(options, "folder:paths", "list of paths to search");
+      set(options, "folder:scan_threads", "number of threads used to search base_dir; found paths are sorted regardless");
+      set(options, "folder:manifest", "if set, a file used to save the search results and the dims and dtype of each path between runs; "
+          "a rescan only lists directories modified since the manifest was written, and metadata read from the manifest "
+          "contains only loader:dims, loader:dtype, and the groups");
+      set(options, "folder:io_mode", "how data is read: loader reads each path with folder:plugin; "
+          "async reads whole files as raw arrays in the background, keeping up to folder:queue_depth reads ahead of the requests, "
+          "and uses folder:plugin only for the dims and dtype of each path");
+      set(options, "folder:async_backend", "how async mode reads: io_uring, pread from a pool of threads, or auto to use io_uring when the kernel provides it");
+      set(options, "folder:queue_depth", "number of reads kept outstanding in async mode");
+      set(options, "folder:direct", "in async mode, bypass the page cache with O_DIRECT where the file system allows it");
       set(options, "folder:rescan", "force a rescan if set");
       return options;
     }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader_plugin->get_metrics_results();
+    }
     
     pressio_data load_data_impl(size_t n) override {
-      if(!paths) scan();
-      pressio_options options;
-      options.set(loader_plugin->get_name(), "io:path", paths->at(n));
-      loader_plugin->set_options(options);
-      return loader_plugin->load_data(n);
+      if(io_mode == "async") {
+        return async_load(n).get();
+      }
+      auto child = child_for(get_paths().at(n));
+      return child->load_data(n);
+    }
+
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      if(io_mode != "async") {
+        return dataset_loader::load_data_batch(indices);
+      }
+      //issue every read before waiting on any of them
+      std::vector<std::future<pressio_data>> reads(indices.size());
+      std::map<size_t, raw_layout> layouts;
+      {
+        std::lock_guard<std::mutex> lock(window.mutex);
+        for (size_t i = 0; i < indices.size(); ++i) {
+          if(!take_pending(indices[i], reads[i])) layouts.emplace(indices[i], raw_layout{});
+        }
+      }
+      //the metadata may come from the child, so look it up without holding window.mutex
+      for (auto& layout : layouts) {
+        layout.second = describe(layout.first);
+      }
+      {
+        std::lock_guard<std::mutex> lock(window.mutex);
+        for (size_t i = 0; i < indices.size(); ++i) {
+          if(!reads[i].valid() && !take_pending(indices[i], reads[i])) {
+            reads[i] = start_read(layouts.at(indices[i]));
+          }
+        }
+      }
+      std::vector<pressio_data> ret;
+      ret.reserve(indices.size());
+      for (auto& read : reads) {
+        ret.emplace_back(read.get());
+      }
+      return ret;
+    }
+
+    bool supports_region_impl() override {
+      return loader_plugin->supports_region();
+    }
+
+    pressio_data load_region_impl(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      auto child = child_for(get_paths().at(n));
+      return child->load_region(n, offset, count);
     }
 
     pressio_options load_metadata_impl(size_t n) override {
-      if(!paths) scan();
-      pressio_options options;
-      options.set(loader_plugin->get_name(), "io:path", paths->at(n));
-      loader_plugin->set_options(options);
-      pressio_options metadata = loader_plugin->load_metadata(0);
+      std::string const& path = get_paths().at(n);
+      std::error_code ec;
+      int64_t mtime = 0;
+      if(manifest) {
+        mtime = folder_manifest::mtime(path, ec);
+        std::vector<size_t> cached_dims;
+        pressio_dtype cached_dtype = pressio_byte_dtype;
+        if(!ec && manifest->find_metadata(path, mtime, loader_hash(), cached_dims, cached_dtype)) {
+          pressio_options metadata;
+          set(metadata, "loader:dims", pressio_data(cached_dims.begin(), cached_dims.end()));
+          set(metadata, "loader:dtype", cached_dtype);
+          set_groups(metadata, path);
+          return metadata;
+        }
+      }
+
+      pressio_options metadata = child_for(path)->load_metadata(0);
+
+      pressio_dtype dtype = pressio_byte_dtype;
+      pressio_data dims;
+      const bool has_dims = metadata.get(loader_plugin->get_name(), "loader:dims", &dims) == pressio_options_key_set;
+      const bool has_dtype = metadata.get(loader_plugin->get_name(), "loader:dtype", &dtype) == pressio_options_key_set;
+      if(has_dims) set(metadata, "loader:dims", dims);
+      if(has_dtype) set(metadata, "loader:dtype", dtype);
+      //only what the child reported is remembered, so a missing key is asked for again next time
+      if(manifest && !ec && has_dims && has_dtype && dims.num_elements() != 0) {
+        manifest->set_metadata(path, folder_manifest::file_metadata{mtime, loader_hash(), dtype, dims.to_vector<size_t>()});
+      }
+
+      set_groups(metadata, path);
+      return metadata;
+    }
+
+    /**
+     * \returns a read of dataset n, and starts reads of the queue_depth-1 datasets that follow it
+     */
+    std::future<pressio_data> async_load(size_t n) {
+      const size_t N = get_paths().size();
+      const size_t depth = std::max<uint64_t>(queue_depth, 1);
+      std::future<pressio_data> ret;
+      std::map<size_t, raw_layout> layouts;
+      {
+        std::lock_guard<std::mutex> lock(window.mutex);
+        if(!take_pending(n, ret)) layouts.emplace(n, raw_layout{});
+        for (size_t i = n + 1; i < std::min(n + depth, N); ++i) {
+          if(window.pending.find(i) == window.pending.end()) layouts.emplace(i, raw_layout{});
+        }
+      }
+      //the metadata may come from the child, so look it up without holding window.mutex
+      for (auto& layout : layouts) {
+        layout.second = describe(layout.first);
+      }
+      std::lock_guard<std::mutex> lock(window.mutex);
+      if(!ret.valid() && !take_pending(n, ret)) {
+        ret = start_read(layouts.at(n));
+      }
+      //forget reads that fell out of the window so memory stays bounded by queue_depth
+      for (auto it = window.pending.begin(); it != window.pending.end();) {
+        if(it->first <= n || it->first >= n + depth) {
+          it = window.pending.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      //reads that another request already started, or took, in the meantime are not repeated
+      for (auto& layout : layouts) {
+        if(layout.first != n && window.pending.find(layout.first) == window.pending.end()) {
+          window.pending.emplace(layout.first, start_read(layout.second));
+        }
+      }
+      return ret;
+    }
 
-      pressio_dtype dtype;
+    /**
+     * what an async read of one dataset needs to know
+     */
+    struct raw_layout {
+      std::string path;
+      pressio_dtype dtype = pressio_byte_dtype;
+      std::vector<size_t> dims;
+    };
+
+    /**
+     * \returns the path and layout of dataset n from its metadata
+     */
+    raw_layout describe(size_t n) {
+      pressio_options metadata = load_metadata_impl(n);
       pressio_data dims;
-      metadata.get(loader_plugin->get_name(), "loader:dims", &dims);
-      metadata.get(loader_plugin->get_name(), "loader:dtype", &dtype);
-      set(metadata, "loader:dims", dims);
-      set(metadata, "loader:dtype", dtype);
-
-      if(!groups.empty()) {
-        std::regex regex(rgx);
-        std::smatch match;
-        if(std::regex_match(paths->at(n), match, regex)) {
-          for (size_t i = 1; i < std::min(match.size(), groups.size()+1); ++i) {
-            std::ssub_match s = match[i];
-            set(metadata, "folder:group:" + groups[i-1], s.str());
+      raw_layout layout;
+      layout.path = get_paths().at(n);
+      metadata.get(get_name(), "loader:dims", &dims);
+      metadata.get(get_name(), "loader:dtype", &layout.dtype);
+      layout.dims = dims.to_vector<size_t>();
+      return layout;
+    }
+
+    /**
+     * move the outstanding read of n, if any, into read; requires window.mutex to be held
+     *
+     * \returns true if there was an outstanding read
+     */
+    bool take_pending(size_t n, std::future<pressio_data>& read) {
+      auto it = window.pending.find(n);
+      if(it == window.pending.end()) return false;
+      read = std::move(it->second);
+      window.pending.erase(it);
+      return true;
+    }
+
+    /**
+     * start reading a dataset as a raw array; requires window.mutex to be held
+     */
+    std::future<pressio_data> start_read(raw_layout const& layout) {
+      if(!window.reader) {
+        window.reader = make_async_reader(async_backend, queue_depth, direct);
+      }
+      return window.reader->read(layout.path, layout.dtype, layout.dims);
+    }
+
+    /**
+     * search base_dir with scan_threads threads
+     *
+     * each thread lists the directories in its own queue and takes directories
+     * from the other queues once its own is empty; threads with nothing to take sleep
+ * until a directory is queued or the search ends.  Like recursive_directory_iterator,
+     * symbolic links to directories are not followed.  When a manifest is used,
+     * directories whose modification time matches the manifest are not listed again.
+     */
+    void scan_impl(std::vector<std::string>& found_paths) {
+      struct work_queue {
+        std::mutex mutex;
+        std::deque<fs::path> dirs;
+      };
+      const size_t nthreads = std::max<size_t>(scan_threads, 1);
+      std::vector<work_queue> queues(nthreads);
+      std::vector<std::vector<std::string>> found(nthreads);
+      std::vector<std::vector<std::pair<std::string, folder_manifest::directory>>> visited(nthreads);
+      folder_manifest::directory_map previous;
+      if(manifest) previous = manifest->take_directories(base_dir, rgx, recursive);
+      //directories queued or being listed; the search is done when this reaches 0
+      std::atomic<size_t> pending{1};
+      //directories waiting in a queue; idle threads sleep on `idle` until this is non-zero
+      std::atomic<size_t> queued{1};
+      std::mutex idle_mutex;
+      std::condition_variable idle;
+      auto wake = [&] {
+        //taking the lock orders the notification after a waiter's check of its predicate
+        { std::lock_guard<std::mutex> lock(idle_mutex); }
+        idle.notify_all();
+      };
+      std::atomic<bool> failed{false};
+      std::mutex error_mutex;
+      std::exception_ptr error;
+      const std::regex regex(rgx);
+      queues[0].dirs.emplace_back(base_dir);
+
+      auto take = [&](size_t id, fs::path& dir) {
+        for (size_t i = 0; i < nthreads; ++i) {
+          work_queue& queue = queues[(id + i) % nthreads];
+          std::lock_guard<std::mutex> lock(queue.mutex);
+          if(queue.dirs.empty()) continue;
+          //work from the back of our own queue, steal from the front of others
+          if(i == 0) {
+            dir = std::move(queue.dirs.back());
+            queue.dirs.pop_back();
+          } else {
+            dir = std::move(queue.dirs.front());
+            queue.dirs.pop_front();
+          }
+          --queued;
+          return true;
+        }
+        return false;
+      };
+
+      auto visit = [&](fs::path const& dir, folder_manifest::directory& entry) {
+        if(manifest) {
+          //read the time before listing so changes made while listing are seen next time
+          std::error_code ec;
+          entry.mtime = folder_manifest::mtime(dir, ec);
+          if(ec) throw fs::filesystem_error("failed to read the modification time", dir, ec);
+          auto it = previous.find(dir.string());
+          if(it != previous.end() && it->second.mtime == entry.mtime) {
+            //each directory is visited once, so its entry can be moved out
+            entry.files = std::move(it->second.files);
+            entry.subdirs = std::move(it->second.subdirs);
+            return;
+          }
+        }
+        for (auto const& dir_entry : fs::directory_iterator(dir)) {
+          if(recursive && dir_entry.is_directory() && !dir_entry.is_symlink()) {
+            entry.subdirs.emplace_back(dir_entry.path().string());
+          } else if(dir_entry.is_regular_file()) {
+            std::string path = dir_entry.path().string();
+            if(std::regex_match(path, regex)) {
+              entry.files.emplace_back(std::move(path));
+            }
+          }
+        }
+      };
+
+      auto work = [&](size_t id) {
+        fs::path dir;
+        while(pending != 0 && !failed) {
+          if(!take(id, dir)) {
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            idle.wait(lock, [&]{ return pending == 0 || failed || queued != 0; });
+            continue;
           }
+          try {
+            folder_manifest::directory entry;
+            visit(dir, entry);
+            found[id].insert(found[id].end(), entry.files.begin(), entry.files.end());
+            if(!entry.subdirs.empty()) {
+              pending += entry.subdirs.size();
+              {
+                std::lock_guard<std::mutex> lock(queues[id].mutex);
+                for (auto const& subdir : entry.subdirs) {
+                  queues[id].dirs.emplace_back(subdir);
+                }
+              }
+              queued += entry.subdirs.size();
+              wake();
+            }
+            if(manifest) {
+              visited[id].emplace_back(dir.string(), std::move(entry));
+            }
+          } catch(...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!error) error = std::current_exception();
+            failed = true;
+          }
+          if(--pending == 0 || failed) wake();
         }
+      };
+
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < nthreads; ++i) {
+        threads.emplace_back(work, i);
       }
-      return metadata;
+      work(0);
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      if(error) std::rethrow_exception(error);
+      for (auto& f : found) {
+        found_paths.insert(found_paths.end(), std::make_move_iterator(f.begin()), std::make_move_iterator(f.end()));
+      }
+      if(manifest) {
+        folder_manifest::directory_map directories;
+        for (auto& v : visited) {
+          for (auto& dir : v) {
+            directories.emplace(std::move(dir));
+          }
+        }
+        manifest->set_directories(base_dir, rgx, recursive, std::move(directories));
+      }
+    }
+
+    std::vector<std::string> scan() {
+      trace::span span("scan", "folder:scan");
+      if(span) span.arg("base_dir", base_dir);
+      std::vector<std::string> found_paths;
+      scan_impl(found_paths);
+      //directory order is unspecified; sort so that indices are stable from run to run
+      std::sort(found_paths.begin(), found_paths.end());
+      return found_paths;
+    }
+
+    std::vector<std::string> const& get_paths() {
+      return paths.get([this]{ return scan(); });
     }
 
-    template <class It>
-    void scan_impl(It dir_it) {
+    /**
+     * \returns a copy of the child configured to read path
+     *
+     * the child is configured before each read, so concurrent calls each lease their own copy
+     */
+    clone_pool<pressio_dataset_loader>::lease child_for(std::string const& path) {
+      auto child = children.acquire(loader_plugin);
+      pressio_options options;
+      options.set((*child)->get_name(), "io:path", path);
+      (*child)->set_options(options);
+      return child;
+    }
+
+    /**
+     * \returns a hash of the child's configuration apart from the path it reads
+     */
+    uint64_t loader_hash() {
+      return child_hash.get([this]{
+        pressio_options options = loader_plugin->get_options();
+        std::vector<std::string> path_keys;
+        for (auto const& option : options) {
+          if(disk_cache_detail::ends_with(option.first, "io:path")) {
+            path_keys.emplace_back(option.first);
+          }
+        }
+        for (auto const& key : path_keys) {
+          options.erase(key);
+        }
+        return configuration_hash(loader_plugin_id, options);
+      });
+    }
+
+    void set_groups(pressio_options& metadata, std::string const& path) const {
+      if(groups.empty()) return;
       std::regex regex(rgx);
       std::smatch match;
-      for (auto const& i : dir_it) {
-        if(!i.is_regular_file()) continue;
-        auto const& path = i.path().string();
-        if(std::regex_match(path, match, regex)) {
-          paths->emplace_back(i.path().string());
+      if(std::regex_match(path, match, regex)) {
+        for (size_t i = 1; i < std::min(match.size(), groups.size()+1); ++i) {
+          std::ssub_match s = match[i];
+          set(metadata, "folder:group:" + groups[i-1], s.str());
         }
       }
     }
-    void scan() {
-      paths = std::vector<std::string>();
-      if(recursive) {
-        scan_impl(fs::recursive_directory_iterator(base_dir));
-      } else {
-        scan_impl(fs::directory_iterator(base_dir));
-      }
-    }
 
     void set_name_impl(std::string const& new_name) override {
       loader_plugin->set_name(new_name + "/" + loader_plugin->prefix());
+      children.clear();
     }
 
     std::unique_ptr<dataset_loader> clone() override {
@@ -148,9 +552,20 @@ namespace libpressio_dataset { namespace folder_loader_ns {
     std::string rgx = ".+";
     std::string base_dir = ".";
     std::vector<std::string> groups;
-    std::optional<std::vector<std::string>> paths;
+    uint64_t scan_threads = 1;
+    std::string manifest_path;
+    //shared between clones so that metadata learned by any of them is saved
+    std::shared_ptr<folder_manifest> manifest;
+    lazy<uint64_t> child_hash;
+    lazy<std::vector<std::string>> paths;
     std::string loader_plugin_id = "io_loader";
     pressio_dataset_loader loader_plugin = dataset_loader_plugins().build("io_loader");
+    clone_pool<pressio_dataset_loader> children;
+    std::string io_mode = "loader";
+    std::string async_backend = "auto";
+    uint64_t queue_depth = 8;
+    bool direct = false;
+    async_window window;
   };
 
   pressio_register folder_loader_register(dataset_loader_plugins(), "folder", []{ return compat::make_unique<folder_loader>(); });
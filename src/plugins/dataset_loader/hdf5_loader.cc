@@ -1,13 +1,26 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <std_compat/memory.h>
+#include <atomic>
+#include <exception>
+#include <list>
+#include <mutex>
 #include <regex>
 #include <sstream>
+#include <thread>
 #include <cleanup.h>
+#include <lazy.h>
+#include <region.h>
+#include <io_probe.h>
+#include <H5Dpublic.h>
 #include <H5Opublic.h>
 #include <H5Fpublic.h>
 #include <H5Ppublic.h>
 #include <H5Tpublic.h>
 #include <H5Spublic.h>
+#include <H5Zpublic.h>
+#if LIBPRESSIO_DATASET_HAS_ZLIB
+#include <zlib.h>
+#endif
 
 namespace libpressio_dataset { namespace hdf5_loader_ns {
 
@@ -28,21 +41,209 @@ namespace libpressio_dataset { namespace hdf5_loader_ns {
     return compat::optional<pressio_dtype>{};
   }
 
+  /**
+   * what scan() learned about a dataset, so metadata can be reported without touching the file
+   */
+  struct dataset_entry {
+    std::string name;
+    std::vector<size_t> dims;
+    compat::optional<pressio_dtype> dtype;
+    /** empty unless the dataset uses chunked storage */
+    std::vector<size_t> chunks;
+    uint64_t storage_size;
+    /** the filter pipeline in the order it is applied when writing */
+    std::vector<H5Z_filter_t> filters;
+    std::vector<std::string> filter_names;
+    /** the address of the data in the file; only known for contiguous storage */
+    compat::optional<uint64_t> offset;
+  };
+
+  /**
+   * \returns true if the chunks of entry can be decoded by decode_chunk rather than inside H5Dread
+   */
+  bool can_decode_chunks(dataset_entry const& entry) {
+    if(entry.chunks.empty() || !entry.dtype) return false;
+    for (auto filter : entry.filters) {
+      if(filter == H5Z_FILTER_SHUFFLE) continue;
+#if LIBPRESSIO_DATASET_HAS_ZLIB
+      if(filter == H5Z_FILTER_DEFLATE) continue;
+#endif
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * undo the filter pipeline of entry on a raw chunk read with H5Dread_chunk
+   *
+   * \param[in] mask bit i is set if filter i was skipped for this chunk
+   * \param[in] chunk_bytes the size of the decoded chunk
+   * \param[in] elem the size of each element in bytes
+   */
+  std::vector<unsigned char> decode_chunk(dataset_entry const& entry, std::vector<unsigned char> raw, uint32_t mask, size_t chunk_bytes, size_t elem) {
+    for (size_t k = entry.filters.size(); k-- > 0;) {
+      if(mask & (1u << k)) continue;
+      if(entry.filters[k] == H5Z_FILTER_SHUFFLE) {
+        //shuffle stores byte b of every element together
+        std::vector<unsigned char> out(raw.size());
+        const size_t n = raw.size() / elem;
+        for (size_t b = 0; b < elem; ++b) {
+          for (size_t i = 0; i < n; ++i) {
+            out[i*elem + b] = raw[b*n + i];
+          }
+        }
+        //trailing bytes that do not form a whole element are stored unshuffled
+        std::copy(raw.begin() + n*elem, raw.end(), out.begin() + n*elem);
+        raw = std::move(out);
+      }
+#if LIBPRESSIO_DATASET_HAS_ZLIB
+      else if(entry.filters[k] == H5Z_FILTER_DEFLATE) {
+        std::vector<unsigned char> out(chunk_bytes);
+        uLongf out_len = out.size();
+        if(uncompress(out.data(), &out_len, raw.data(), raw.size()) != Z_OK) {
+          throw std::runtime_error("failed to inflate chunk of " + entry.name);
+        }
+        out.resize(out_len);
+        raw = std::move(out);
+      }
+#endif
+      else {
+        throw std::runtime_error("unsupported filter for " + entry.name);
+      }
+    }
+    if(raw.size() != chunk_bytes) {
+      throw std::runtime_error("unexpected chunk size for " + entry.name);
+    }
+    return raw;
+  }
+
+  /**
+   * what the H5Ovisit callback needs to build the index in one pass
+   */
+  struct scan_state {
+    std::regex const& regex;
+    std::vector<dataset_entry>& entries;
+  };
+
+  /**
+   * an open dataset and its type
+   */
+  struct open_dataset {
+    size_t n;
+    hid_t did;
+    hid_t tid;
+  };
+
+  /**
+   * HDF5 is not reentrant unless built with --enable-threadsafe, so every call
+   * into it, from any loader in the process, holds this lock
+   */
+  std::recursive_mutex& hdf5_mutex() {
+    static std::recursive_mutex mutex;
+    return mutex;
+  }
+
+  /**
+   * the file and recently used datasets kept open between calls
+   *
+   * callers must hold hdf5_mutex() while using the handles.
+   * copies start closed so that clones open their own identifiers
+   */
+  class hdf5_handles {
+    public:
+    hdf5_handles()=default;
+    hdf5_handles(hdf5_handles const&) {}
+    hdf5_handles& operator=(hdf5_handles const&) {
+      close();
+      return *this;
+    }
+    ~hdf5_handles() {
+      close();
+    }
+
+    hid_t file(std::string const& filename) {
+      if(fid < 0) {
+        fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if(fid < 0) {
+            throw std::runtime_error("failed to open file");
+        }
+      }
+      return fid;
+    }
+
+    /**
+     * \returns dataset n named name, keeping at most capacity datasets open
+     */
+    open_dataset const& dataset(std::string const& filename, size_t n, std::string const& name, size_t capacity) {
+      for (auto it = datasets.begin(); it != datasets.end(); ++it) {
+        if(it->n == n) {
+          datasets.splice(datasets.begin(), datasets, it);
+          return datasets.front();
+        }
+      }
+      hid_t did = H5Dopen2(file(filename), name.c_str(), H5P_DEFAULT);
+      if(did < 0) {
+          throw std::runtime_error("failed to open dataset " + name);
+      }
+      hid_t tid = H5Dget_type(did);
+      if(tid < 0) {
+          H5Dclose(did);
+          throw std::runtime_error("failed to get type " + name);
+      }
+      while(!datasets.empty() && datasets.size() >= std::max<size_t>(capacity, 1)) {
+        close_dataset(datasets.back());
+        datasets.pop_back();
+      }
+      datasets.emplace_front(open_dataset{n, did, tid});
+      return datasets.front();
+    }
+
+    void close_datasets() {
+      std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+      for (auto const& ds : datasets) {
+        close_dataset(ds);
+      }
+      datasets.clear();
+    }
+
+    void close() {
+      std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+      close_datasets();
+      if(fid >= 0) {
+        H5Fclose(fid);
+        fid = -1;
+      }
+    }
+
+    private:
+    static void close_dataset(open_dataset const& ds) {
+      H5Tclose(ds.tid);
+      H5Dclose(ds.did);
+    }
+
+    hid_t fid = -1;
+    std::list<open_dataset> datasets;
+  };
+
   struct hdf5_loader: public dataset_loader_base {
 
-    void scan() {
-      if(!files){
-          files = std::vector<std::string>();
+    std::vector<dataset_entry> const& scan() {
+      return files.get([this]{
+          trace::span span("scan", "hdf5_datasets:scan");
+          if(span) span.arg("file", filename);
+          std::vector<dataset_entry> entries;
+          std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
           H5open();
-          hid_t fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-          H5Ovisit(fid, H5_INDEX_NAME, H5_ITER_NATIVE, libpressio_dataset_loader_iterate_hdf5, this, H5O_INFO_BASIC);
-          H5Fclose(fid);
-      }
+          scan_state state{regex, entries};
+          if(H5Ovisit(handles.file(filename), H5_INDEX_NAME, H5_ITER_NATIVE, libpressio_dataset_loader_iterate_hdf5, &state, H5O_INFO_BASIC) < 0) {
+            throw std::runtime_error("failed to scan " + filename);
+          }
+          return entries;
+      });
     }
 
     size_t num_datasets_impl() override {
-      scan();
-      return files->size();
+      return scan().size();
     }
 
     int set_options_impl(pressio_options const& options) override {
@@ -50,14 +251,33 @@ namespace libpressio_dataset { namespace hdf5_loader_ns {
       if(get(options, "io:path", &new_filename) == pressio_options_key_set && new_filename != filename) {
         filename = std::move(new_filename);
         files.reset();
+        handles.close();
       }
 
       std::string new_regex = pattern;
       if(get(options, "hdf5_datasets:regex", &new_regex) == pressio_options_key_set && new_regex != pattern) {
+        try {
+          regex = std::regex(new_regex);
+        } catch(std::regex_error const& ex) {
+          return set_error(1, std::string("invalid hdf5_datasets:regex: ") + ex.what());
+        }
         pattern = std::move(new_regex);
         files.reset();
+        //the open datasets are keyed by index, which the new pattern may renumber
+        handles.close_datasets();
       }
       get(options, "hdf5_datasets:groups", &groups);
+      get(options, "hdf5_datasets:decode_threads", &decode_threads);
+      if(get(options, "hdf5_datasets:open_datasets", &open_datasets) == pressio_options_key_set) {
+        handles.close_datasets();
+      }
+
+      //provide a way to force a re-scan, i.e. after the file was modified
+      bool tmp;
+      if(get(options, "hdf5_datasets:rescan", &tmp) == pressio_options_key_set) {
+        files.reset();
+        handles.close();
+      }
 
       return 0;
     }
@@ -67,6 +287,8 @@ namespace libpressio_dataset { namespace hdf5_loader_ns {
       set(options, "io:path", filename);
       set(options, "hdf5_datasets:regex", pattern);
       set(options, "hdf5_datasets:groups", groups);
+      set(options, "hdf5_datasets:open_datasets", open_datasets);
+      set(options, "hdf5_datasets:decode_threads", decode_threads);
       set_type(options, "hdf5_datasets:rescan", pressio_option_bool_type);
       return options;
     }
@@ -76,84 +298,92 @@ namespace libpressio_dataset { namespace hdf5_loader_ns {
       set(options, "io:path", "path to load data from");
       set(options, "hdf5_datasets:regex", "if this regex matches, load this dataset");
       set(options, "hdf5_datasets:groups", "names for match expresison in the regex");
+      set(options, "hdf5_datasets:open_datasets", "number of recently used datasets to keep open; the most recent is always kept open");
+      set(options, "hdf5_datasets:decode_threads", "if greater than 1, read chunked datasets whose filters are supported one chunk at a time and decode the chunks on this many threads");
       set(options, "hdf5_datasets:rescan", "force a rescan if set");
       return options;
     }
     
     pressio_data load_data_impl(size_t n) override {
-      hid_t fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-      if(fid < 0) {
-          throw std::runtime_error("failed to open file");
+      dataset_entry const& entry = scan().at(n);
+      if(!entry.dtype) throw std::runtime_error("failed to convert type");
+      if(decode_threads > 1 && can_decode_chunks(entry)) {
+        if(auto decoded = read_chunks(n, entry, std::vector<size_t>(entry.dims.size(), 0), entry.dims)) {
+          return std::move(*decoded);
+        }
+      }
+      std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+      open_dataset const& ds = handles.dataset(filename, n, entry.name, open_datasets);
+      pressio_data ret(pressio_data::owning(*entry.dtype, entry.dims));
+      trace::span span("hdf5", "H5Dread");
+      if(H5Dread(ds.did, ds.tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, ret.data()) < 0) {
+          throw std::runtime_error("failed to read " + entry.name);
       }
-      auto cleanup_fid = make_cleanup([fid]{ H5Fclose(fid);});
+      return ret;
+    }
 
-      hid_t did = H5Dopen2(fid, files->at(n).c_str(), H5P_DEFAULT);
-      if(did < 0) {
-          throw std::runtime_error("failed to open dataset " + files->at(n));
+    bool supports_region_impl() override {
+      return true;
+    }
+
+    /**
+     * read only the hyperslab described by offset and count
+     */
+    pressio_data load_region_impl(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      dataset_entry const& entry = scan().at(n);
+      check_region(entry.dims, offset, count);
+      if(!entry.dtype) throw std::runtime_error("failed to convert type");
+      pressio_data ret(pressio_data::owning(*entry.dtype, count));
+      if(ret.num_elements() == 0) return ret;
+
+      if(decode_threads > 1 && can_decode_chunks(entry)) {
+        if(auto decoded = read_chunks(n, entry, offset, count)) {
+          return std::move(*decoded);
+        }
       }
-      auto cleanup_did = make_cleanup([did]{ H5Dclose(did);});
-      hid_t sid = H5Dget_space(did);
+      std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+      open_dataset const& ds = handles.dataset(filename, n, entry.name, open_datasets);
+      hid_t sid = H5Dget_space(ds.did);
       if(sid < 0) {
-          throw std::runtime_error("failed to get space " + files->at(n));
+          throw std::runtime_error("failed to get space " + entry.name);
       }
       auto cleanup_sid = make_cleanup([sid]{ H5Sclose(sid);});
-      hid_t tid = H5Dget_type(did);
-      if(tid < 0) {
-          throw std::runtime_error("failed to get type " + files->at(n));
+      std::vector<hsize_t> hoffset(offset.begin(), offset.end());
+      std::vector<hsize_t> hcount(count.begin(), count.end());
+      if(H5Sselect_hyperslab(sid, H5S_SELECT_SET, hoffset.data(), nullptr, hcount.data(), nullptr) < 0) {
+          throw std::runtime_error("failed to select region of " + entry.name);
+      }
+      hid_t mid = H5Screate_simple(static_cast<int>(hcount.size()), hcount.data(), nullptr);
+      if(mid < 0) {
+          throw std::runtime_error("failed to create memory space for " + entry.name);
+      }
+      auto cleanup_mid = make_cleanup([mid]{ H5Sclose(mid);});
+      trace::span span("hdf5", "H5Dread");
+      if(H5Dread(ds.did, ds.tid, mid, sid, H5P_DEFAULT, ret.data()) < 0) {
+          throw std::runtime_error("failed to read region of " + entry.name);
       }
-      auto cleanup_tid = make_cleanup([tid]{ H5Tclose(tid);});
-
-      const int ndims = H5Sget_simple_extent_ndims(sid);
-      std::vector<hsize_t> hdims(ndims, 0);
-      H5Sget_simple_extent_dims(sid, hdims.data(), nullptr);
-      std::vector<uint64_t> dims(hdims.begin(), hdims.end());
-
-      auto dtype = h5t_to_pressio(tid);
-      pressio_data ret(pressio_data::owning(*dtype, dims));
-
-      H5Dread(did, tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, ret.data());
       return ret;
     }
 
+    /**
+     * reported from what scan() recorded without any HDF5 calls
+     */
     pressio_options load_metadata_impl(size_t n) override {
-      scan();
+      dataset_entry const& entry = scan().at(n);
+      if(!entry.dtype) throw std::runtime_error("failed to convert type");
       pressio_options metadata;
-
-      hid_t fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-      if(fid < 0) {
-          throw std::runtime_error("failed to open file");
-      }
-      auto cleanup_fid = make_cleanup([fid]{ H5Fclose(fid);});
-      hid_t did = H5Dopen2(fid, files->at(n).c_str(), H5P_DEFAULT);
-      if(did < 0) {
-          throw std::runtime_error("failed to open dataset " + files->at(n));
-      }
-      auto cleanup_did = make_cleanup([did]{ H5Dclose(did);});
-      hid_t sid = H5Dget_space(did);
-      if(sid < 0) {
-          throw std::runtime_error("failed to get space " + files->at(n));
+      set(metadata, "loader:dims", pressio_data(entry.dims.begin(), entry.dims.end()));
+      set(metadata, "loader:dtype", *entry.dtype);
+      set(metadata, "hdf5_datasets:path", entry.name);
+      set(metadata, "loader:chunks", pressio_data(entry.chunks.begin(), entry.chunks.end()));
+      set(metadata, "hdf5_datasets:filters", entry.filter_names);
+      set(metadata, "hdf5_datasets:storage_size", entry.storage_size);
+      if(entry.offset) {
+        set(metadata, "loader:offset", *entry.offset);
       }
-      auto cleanup_sid = make_cleanup([sid]{ H5Sclose(sid);});
-      hid_t tid = H5Dget_type(did);
-      if(tid < 0) {
-          throw std::runtime_error("failed to get type " + files->at(n));
-      }
-      auto cleanup_tid = make_cleanup([tid]{ H5Tclose(tid);});
-
-      const int ndims = H5Sget_simple_extent_ndims(sid);
-      std::vector<hsize_t> hdims(ndims, 0);
-      H5Sget_simple_extent_dims(sid, hdims.data(), nullptr);
-      std::vector<uint64_t> dims(hdims.begin(), hdims.end());
-
-      auto dtype = h5t_to_pressio(tid);
-      if(!dtype) throw std::runtime_error("failed to convert type");
-
-      set(metadata, "loader:dims", pressio_data(dims.begin(), dims.end()));
-      set(metadata, "loader:dtype", *dtype);
       if(!groups.empty()) {
-        std::regex regex(pattern);
         std::smatch match;
-        if(std::regex_match(files->at(n), match, regex)) {
+        if(std::regex_match(entry.name, match, regex)) {
           for (size_t i = 1; i < std::min(match.size(), groups.size()+1); ++i) {
             std::ssub_match s = match[i];
             set(metadata, "hdf5_datasets:group:" + groups[i-1], s.str());
@@ -163,6 +393,99 @@ namespace libpressio_dataset { namespace hdf5_loader_ns {
       return metadata;
     }
 
+    /**
+     * read the chunks of entry that overlap a region with H5Dread_chunk and decode them on decode_threads threads
+     *
+     * HDF5 itself is only called from this thread, and hdf5_mutex() is released before decoding
+     *
+     * \returns an empty optional if a chunk was never written, in which case H5Dread must supply the fill value
+     */
+    compat::optional<pressio_data> read_chunks(size_t n, dataset_entry const& entry, std::vector<size_t> const& offset, std::vector<size_t> const& count) {
+      pressio_data ret(pressio_data::owning(*entry.dtype, count));
+      if(ret.num_elements() == 0) return ret;
+      const size_t ndims = entry.dims.size();
+      std::unique_lock<std::recursive_mutex> lock(hdf5_mutex());
+      open_dataset const& ds = handles.dataset(filename, n, entry.name, open_datasets);
+      const size_t elem = H5Tget_size(ds.tid);
+      size_t chunk_bytes = elem;
+      for (auto c : entry.chunks) chunk_bytes *= c;
+
+      struct raw_chunk {
+        std::vector<size_t> origin;
+        std::vector<unsigned char> bytes;
+        uint32_t mask;
+      };
+      std::vector<raw_chunk> raw;
+      std::vector<size_t> first(ndims), last(ndims);
+      for (size_t i = 0; i < ndims; ++i) {
+        first[i] = offset[i] / entry.chunks[i];
+        last[i] = (offset[i] + count[i] - 1) / entry.chunks[i];
+      }
+      std::vector<size_t> position = first;
+      trace::span read_span("hdf5", "H5Dread_chunk");
+      while(true) {
+        raw_chunk chunk;
+        chunk.mask = 0;
+        std::vector<hsize_t> horigin(ndims);
+        for (size_t i = 0; i < ndims; ++i) {
+          chunk.origin.emplace_back(position[i] * entry.chunks[i]);
+          horigin[i] = chunk.origin[i];
+        }
+        hsize_t stored = 0;
+        if(H5Dget_chunk_storage_size(ds.did, horigin.data(), &stored) < 0 || stored == 0) return {};
+        chunk.bytes.resize(stored);
+        if(H5Dread_chunk(ds.did, H5P_DEFAULT, horigin.data(), &chunk.mask, chunk.bytes.data()) < 0) return {};
+        raw.emplace_back(std::move(chunk));
+
+        size_t i = ndims;
+        while(i-- > 0) {
+          if(++position[i] <= last[i]) break;
+          position[i] = first[i];
+        }
+        if(i == static_cast<size_t>(-1)) break;
+      }
+      read_span.end();
+      lock.unlock();
+
+      //each chunk fills a disjoint part of ret, so the workers need no synchronization
+      std::atomic<size_t> next{0};
+      std::atomic<bool> failed{false};
+      std::mutex error_mutex;
+      std::exception_ptr error;
+      auto work = [&]{
+        try {
+          for (size_t c = next++; c < raw.size() && !failed; c = next++) {
+            raw_chunk& chunk = raw[c];
+            trace::span span("hdf5", "decode_chunk");
+            auto bytes = decode_chunk(entry, std::move(chunk.bytes), chunk.mask, chunk_bytes, elem);
+            std::vector<size_t> src_offset(ndims), dst_offset(ndims), box(ndims);
+            for (size_t i = 0; i < ndims; ++i) {
+              const size_t lo = std::max(chunk.origin[i], offset[i]);
+              const size_t hi = std::min(chunk.origin[i] + entry.chunks[i], offset[i] + count[i]);
+              src_offset[i] = lo - chunk.origin[i];
+              dst_offset[i] = lo - offset[i];
+              box[i] = hi - lo;
+            }
+            copy_box(bytes.data(), entry.chunks, src_offset, ret.data(), count, dst_offset, box, elem);
+          }
+        } catch(...) {
+          std::lock_guard<std::mutex> error_lock(error_mutex);
+          if(!error) error = std::current_exception();
+          failed = true;
+        }
+      };
+      std::vector<std::thread> threads;
+      for (size_t t = 1; t < std::min<size_t>(decode_threads, raw.size()); ++t) {
+        threads.emplace_back(work);
+      }
+      work();
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      if(error) std::rethrow_exception(error);
+      return ret;
+    }
+
     std::unique_ptr<dataset_loader> clone() override {
             return std::make_unique<hdf5_loader>(*this);
     }
@@ -183,34 +506,110 @@ namespace libpressio_dataset { namespace hdf5_loader_ns {
 
     std::string filename;
     std::string pattern = ".+";
-    std::optional<std::vector<std::string>> files;
+    std::regex regex{pattern};
+    lazy<std::vector<dataset_entry>> files;
     std::vector<std::string> groups;
-    friend herr_t libpressio_dataset_loader_iterate_hdf5(hid_t, const char*, const H5O_info_t, void*);
+    uint64_t open_datasets = 16;
+    uint64_t decode_threads = 1;
+    hdf5_handles handles;
   };
 
   extern "C" herr_t libpressio_dataset_loader_iterate_hdf5 (hid_t obj, const char *name, const H5O_info_t *info, void *op_data) {
-      hdf5_loader* ptr = static_cast<hdf5_loader*>(op_data);
-      if(info->type == H5O_TYPE_DATASET) {
-          hid_t did = H5Dopen(obj, name, H5P_DEFAULT);
-          hid_t tid = H5Dget_type(did);
-          if(tid < 0) {
-              throw std::runtime_error("unexpected type");
-          }
-          H5T_class_t cid = H5Tget_class(tid);
-          std::regex regex(ptr->pattern);
-          std::smatch match;
-          if(cid == H5T_INTEGER || cid == H5T_FLOAT) {
-                std::string str(name);
-                if(std::regex_match(str, match, regex)) {
-                  ptr->files->emplace_back(name);
-                }
+      scan_state* state = static_cast<scan_state*>(op_data);
+      if(info->type != H5O_TYPE_DATASET) return 0;
+      //matching the name first avoids opening datasets that will not be loaded
+      if(!std::regex_match(name, state->regex)) return 0;
+
+      hid_t did = H5Dopen(obj, name, H5P_DEFAULT);
+      if(did < 0) {
+          return -1;
+      }
+      auto cleanup_did = make_cleanup([did]{ H5Dclose(did);});
+      hid_t tid = H5Dget_type(did);
+      if(tid < 0) {
+          return -1;
+      }
+      auto cleanup_tid = make_cleanup([tid]{ H5Tclose(tid);});
+      H5T_class_t cid = H5Tget_class(tid);
+      if(cid != H5T_INTEGER && cid != H5T_FLOAT) return 0;
+
+      hid_t sid = H5Dget_space(did);
+      if(sid < 0) {
+          return -1;
+      }
+      auto cleanup_sid = make_cleanup([sid]{ H5Sclose(sid);});
+      const int ndims = H5Sget_simple_extent_ndims(sid);
+      std::vector<hsize_t> hdims(std::max(ndims, 0), 0);
+      H5Sget_simple_extent_dims(sid, hdims.data(), nullptr);
+
+      std::vector<size_t> chunks;
+      std::vector<H5Z_filter_t> filters;
+      std::vector<std::string> filter_names;
+      hid_t pid = H5Dget_create_plist(did);
+      if(pid >= 0) {
+        auto cleanup_pid = make_cleanup([pid]{ H5Pclose(pid);});
+        if(H5Pget_layout(pid) == H5D_CHUNKED) {
+          std::vector<hsize_t> hchunks(hdims.size(), 0);
+          if(H5Pget_chunk(pid, static_cast<int>(hchunks.size()), hchunks.data()) >= 0) {
+            chunks.assign(hchunks.begin(), hchunks.end());
           }
-          H5Tclose(tid);
+        }
+        const int nfilters = H5Pget_nfilters(pid);
+        for (int i = 0; i < nfilters; ++i) {
+          unsigned int flags;
+          size_t cd_nelmts = 0;
+          unsigned int filter_config;
+          char filter_name[256] = {0};
+          H5Z_filter_t filter = H5Pget_filter2(pid, i, &flags, &cd_nelmts, nullptr, sizeof(filter_name), filter_name, &filter_config);
+          filters.emplace_back(filter);
+          filter_names.emplace_back(filter_name);
+        }
+      }
+
+      compat::optional<uint64_t> offset;
+      const haddr_t addr = H5Dget_offset(did);
+      if(addr != HADDR_UNDEF) {
+        offset = static_cast<uint64_t>(addr);
       }
-      
+
+      state->entries.emplace_back(dataset_entry{
+          name,
+          std::vector<size_t>(hdims.begin(), hdims.end()),
+          h5t_to_pressio(tid),
+          std::move(chunks),
+          H5Dget_storage_size(did),
+          std::move(filters),
+          std::move(filter_names),
+          offset
+      });
       return 0;
   };
 
 
   pressio_register hdf5_loader_register(dataset_loader_plugins(), "hdf5_datasets", []{ return compat::make_unique<hdf5_loader>(); });
-}}
+}
+
+compat::optional<probed_metadata> probe_hdf5(std::string const& path, std::string const& dataset) {
+  using namespace hdf5_loader_ns;
+  std::lock_guard<std::recursive_mutex> lock(hdf5_mutex());
+  hid_t fid = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if(fid < 0) return {};
+  auto cleanup_fid = make_cleanup([fid]{ H5Fclose(fid); });
+  hid_t did = H5Dopen2(fid, dataset.c_str(), H5P_DEFAULT);
+  if(did < 0) return {};
+  auto cleanup_did = make_cleanup([did]{ H5Dclose(did); });
+  hid_t tid = H5Dget_type(did);
+  if(tid < 0) return {};
+  auto cleanup_tid = make_cleanup([tid]{ H5Tclose(tid); });
+  hid_t sid = H5Dget_space(did);
+  if(sid < 0) return {};
+  auto cleanup_sid = make_cleanup([sid]{ H5Sclose(sid); });
+
+  auto dtype = h5t_to_pressio(tid);
+  const int ndims = H5Sget_simple_extent_ndims(sid);
+  if(!dtype || ndims < 0) return {};
+  std::vector<hsize_t> hdims(ndims);
+  H5Sget_simple_extent_dims(sid, hdims.data(), nullptr);
+  return probed_metadata{std::vector<size_t>(hdims.begin(), hdims.end()), *dtype};
+}
+}
@@ -1,20 +1,33 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <libpressio_ext/cpp/io.h>
 #include <std_compat/memory.h>
+#include <cleanup.h>
+#include <clone_pool.h>
+#include <io_probe.h>
+#include <region.h>
 #include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace libpressio_dataset { namespace io_loader {
 
   struct io_loader: public dataset_loader_base {
 
     size_t num_datasets_impl() override {
+        std::string path;
+        if(probe && plugin_path(path)) {
+          struct stat s;
+          return (stat(path.c_str(), &s) == 0) ? 1 : 0;
+        }
 
         std::unique_ptr<pressio_data, void(*)(pressio_data*)> ptr(nullptr, pressio_data_free);
+        auto reader = readers.acquire(io_plugin);
         if(use_template) {
-            ptr.reset((io_plugin->read(nullptr)));
+            ptr.reset(((*reader)->read(nullptr)));
         } else {
             pressio_data template_data(pressio_data::owning(dtype, dims));
-            ptr.reset((io_plugin->read(&template_data)));
+            ptr.reset(((*reader)->read(&template_data)));
         }
         if(ptr) return 1;
         else return 0;
@@ -22,12 +35,14 @@ namespace libpressio_dataset { namespace io_loader {
 
     int set_options_impl(pressio_options const& options) override {
       get_meta(options, "io_loader:plugin", io_plugins(), io, io_plugin);
+      readers.clear();
       pressio_data tmp_dims;
       if(get(options, "io_loader:dims", &tmp_dims) == pressio_options_key_set) {
         dims = tmp_dims.to_vector<size_t>();
       }
       get(options, "io_loader:dtype", &dtype);
       get(options, "io_loader:use_template", &use_template);
+      get(options, "io_loader:probe", &probe);
       return 0;
     }
 
@@ -37,29 +52,34 @@ namespace libpressio_dataset { namespace io_loader {
       set(options, "io_loader:dims", pressio_data(dims.begin(), dims.end()));
       set(options, "io_loader:dtype", dtype);
       set(options, "io_loader:use_template", use_template);
+      set(options, "io_loader:probe", probe);
       return options;
     }
 
     pressio_options get_documentation_impl() const override {
       pressio_options options;
       set_meta_docs(options, "io_loader:plugin", "io plugin to load the data", io_plugin);
+      set(options, "io_loader:probe", "find whether the file exists and its dims and dtype from the file system or the file's "
+          "header where the io plugin's format allows it, instead of reading the whole file");
       return options;
     }
     
     pressio_data load_data_impl(size_t) override {
+      //io plugins record errors on themselves, so concurrent reads each use their own copy
+      auto reader = readers.acquire(io_plugin);
       if (use_template) {
         pressio_data template_data(pressio_data::owning(dtype, dims));
-        pressio_data* ptr = io_plugin->read(&template_data);
+        pressio_data* ptr = (*reader)->read(&template_data);
         if(ptr == nullptr) {
-          throw std::runtime_error(io_plugin->error_msg());
+          throw std::runtime_error((*reader)->error_msg());
         }
         pressio_data out = std::move(*ptr);
         pressio_data_free(ptr);
         return out;
       } else {
-        pressio_data* ptr = io_plugin->read(nullptr);
+        pressio_data* ptr = (*reader)->read(nullptr);
         if(ptr == nullptr) {
-          throw std::runtime_error(io_plugin->error_msg());
+          throw std::runtime_error((*reader)->error_msg());
         }
         pressio_data out = std::move(*ptr);
         pressio_data_free(ptr);
@@ -67,13 +87,56 @@ namespace libpressio_dataset { namespace io_loader {
       }
     }
 
+    /**
+     * raw files with known dimensions can be read in place; other formats must be decoded in full
+     */
+    bool supports_region_impl() override {
+      return use_template && io == "posix";
+    }
+
+    pressio_data load_region_impl(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      if(!supports_region_impl()) {
+        return dataset_loader::load_region(n, offset, count);
+      }
+      check_region(dims, offset, count);
+      const std::string path = posix_path();
+      int fd = open(path.c_str(), O_RDONLY);
+      if(fd < 0) {
+        throw std::runtime_error("failed to open " + path);
+      }
+      auto cleanup_fd = make_cleanup([fd]{ close(fd); });
+
+      pressio_data ret = pressio_data::owning(dtype, count);
+      const size_t elem = pressio_dtype_size(dtype);
+      auto dst = static_cast<char*>(ret.data());
+      for_each_region_run(dims, offset, count, [&](size_t src_elem, size_t dst_elem, size_t n_elems) {
+          size_t remaining = n_elems * elem;
+          char* ptr = dst + dst_elem * elem;
+          off_t pos = src_elem * elem;
+          while(remaining > 0) {
+            ssize_t got = pread(fd, ptr, remaining, pos);
+            if(got <= 0) {
+              throw std::runtime_error("short read from " + path);
+            }
+            remaining -= got;
+            ptr += got;
+            pos += got;
+          }
+      });
+      return ret;
+    }
+
     pressio_options load_metadata_impl(size_t) override {
       pressio_options metadata;
       if(use_template) {
         set(metadata, "loader:dims", pressio_data(dims.begin(), dims.end()));
         set(metadata, "loader:dtype", dtype);
+      } else if(auto probed = probe_metadata()) {
+        set(metadata, "loader:dims", pressio_data(probed->dims.begin(), probed->dims.end()));
+        set(metadata, "loader:dtype", probed->dtype);
       } else {
-        std::unique_ptr<pressio_data, void(*)(pressio_data*)> ptr(io_plugin->read(nullptr), pressio_data_free);
+        auto reader = readers.acquire(io_plugin);
+        std::unique_ptr<pressio_data, void(*)(pressio_data*)> ptr((*reader)->read(nullptr), pressio_data_free);
         if(ptr) {
             auto const& ddims = ptr->dimensions();
             set(metadata, "loader:dims", pressio_data(ddims.begin(), ddims.end()));
@@ -89,6 +152,7 @@ namespace libpressio_dataset { namespace io_loader {
 
     void set_name_impl(std::string const& new_name) override {
       io_plugin->set_name(new_name + '/' + io_plugin->prefix());
+      readers.clear();
     }
 
     const char* prefix() const override {
@@ -105,9 +169,50 @@ namespace libpressio_dataset { namespace io_loader {
       return s.c_str();
     }
 
+    std::string posix_path() const {
+      std::string path;
+      io_plugin->get_options().get(io_plugin->get_name(), "io:path", &path);
+      return path;
+    }
+
+    /**
+     * \returns true if the io plugin reads a single file named by io:path, and sets path to it
+     */
+    bool plugin_path(std::string& path) const {
+      return io_plugin->get_options().get(io_plugin->get_name(), "io:path", &path) == pressio_options_key_set && !path.empty();
+    }
+
+    /**
+     * learn what read(nullptr) would return without reading the data
+     *
+     * \returns nothing if probing is disabled or the plugin's format is not understood
+     */
+    compat::optional<probed_metadata> probe_metadata() const {
+      std::string path;
+      if(!probe || !plugin_path(path)) return {};
+      if(io == "posix") {
+        //without a template, posix reads the whole file as bytes
+        struct stat s;
+        if(stat(path.c_str(), &s) != 0) return {};
+        return probed_metadata{{static_cast<size_t>(s.st_size)}, pressio_byte_dtype};
+      } else if(io == "numpy") {
+        return probe_npy(path);
+      }
+#if LIBPRESSIO_DATASET_HAS_HDF5
+      else if(io == "hdf5") {
+        std::string dataset;
+        io_plugin->get_options().get(io_plugin->get_name(), "hdf5:dataset", &dataset);
+        return probe_hdf5(path, dataset);
+      }
+#endif
+      return {};
+    }
+
     std::string io = "posix";
     pressio_io io_plugin = io_plugins().build(io);
+    clone_pool<pressio_io> readers;
     bool use_template = false;
+    bool probe = true;
     std::vector<size_t> dims;
     pressio_dtype dtype;
   };
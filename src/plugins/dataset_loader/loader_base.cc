@@ -1,7 +1,152 @@
 #include <libpressio_dataset_ext/loader.h>
+#include <region.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 namespace libpressio_dataset {
   pressio_registry<std::unique_ptr<dataset_loader>>& dataset_loader_plugins() {
     static pressio_registry<std::unique_ptr<dataset_loader>> loader;
     return loader;
   }
+
+  namespace {
+    /**
+     * calls f(loader, i) for each i in [0,N) using up to nthreads threads
+     *
+     * the calling thread uses self; every other thread uses its own clone of self
+     * so loaders do not need to be reentrant.  The first exception is rethrown
+     * after all threads have stopped.
+     */
+    template <class Function>
+    void for_each_index(dataset_loader& self, size_t N, uint64_t nthreads, Function&& f) {
+      const size_t n_workers = std::min<size_t>(std::max<uint64_t>(nthreads, 1), N);
+      if(n_workers <= 1) {
+        for (size_t i = 0; i < N; ++i) {
+          f(self, i);
+        }
+        return;
+      }
+
+      std::atomic<size_t> next{0};
+      std::atomic<bool> failed{false};
+      std::mutex error_mutex;
+      std::exception_ptr error;
+      auto work = [&](dataset_loader& loader) {
+        try {
+          for (size_t i = next++; i < N && !failed; i = next++) {
+            f(loader, i);
+          }
+        } catch(...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if(!error) error = std::current_exception();
+          failed = true;
+        }
+      };
+
+      std::vector<std::unique_ptr<dataset_loader>> clones;
+      for (size_t i = 1; i < n_workers; ++i) {
+        clones.emplace_back(self.clone());
+      }
+      std::vector<std::thread> threads;
+      for (auto& clone : clones) {
+        threads.emplace_back(work, std::ref(*clone));
+      }
+      work(self);
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      if(error) std::rethrow_exception(error);
+    }
+  }
+
+  std::vector<pressio_options> dataset_loader::load_all_metadata() {
+    const size_t N = num_datasets();
+    std::vector<pressio_options> ret(N);
+    for_each_index(*this, N, nthreads, [&ret](dataset_loader& loader, size_t i) {
+        ret[i] = loader.load_metadata(i);
+    });
+    return ret;
+  }
+
+  std::vector<pressio_data> dataset_loader::load_all_data() {
+    const size_t N = num_datasets();
+    std::vector<pressio_data> ret(N);
+    for_each_index(*this, N, nthreads, [&ret](dataset_loader& loader, size_t i) {
+        ret[i] = loader.load_data(i);
+    });
+    return ret;
+  }
+
+  /**
+   * the progress of a load from load_data_async
+   */
+  struct async_load::state {
+    //whichever of the executor and cancel moves the load out of pending completes it
+    enum { pending, claimed };
+    std::atomic<int> stage{pending};
+    std::promise<pressio_data> promise;
+    /** only set for loads with a callback, which receives the future */
+    std::function<void(std::future<pressio_data>)> then;
+    std::future<pressio_data> future;
+
+    void complete() {
+      if(then) then(std::move(future));
+    }
+  };
+
+  namespace {
+    /**
+     * the threads that run load_data_async
+     *
+     * loads mostly wait on I/O, so there are at least a few even on small machines
+     */
+    thread_pool& async_executor() {
+      static thread_pool pool(std::max(std::thread::hardware_concurrency(), 4u));
+      return pool;
+    }
+
+    async_load schedule(dataset_loader& loader, size_t n, std::function<void(std::future<pressio_data>)> then) {
+      auto load = std::make_shared<async_load::state>();
+      std::future<pressio_data> future = load->promise.get_future();
+      if(then) {
+        load->then = std::move(then);
+        load->future = std::move(future);
+      }
+      async_executor().submit([&loader, n, load](size_t) {
+          int expected = async_load::state::pending;
+          if(!load->stage.compare_exchange_strong(expected, async_load::state::claimed)) return;
+          try {
+            load->promise.set_value(loader.load_data(n));
+          } catch(...) {
+            load->promise.set_exception(std::current_exception());
+          }
+          load->complete();
+      });
+      return async_load(std::move(load), std::move(future));
+    }
+  }
+
+  bool async_load::cancel() {
+    if(!load) return false;
+    int expected = state::pending;
+    if(!load->stage.compare_exchange_strong(expected, state::claimed)) return false;
+    load->promise.set_exception(std::make_exception_ptr(load_cancelled()));
+    load->complete();
+    return true;
+  }
+
+  async_load dataset_loader::load_data_async(size_t n) {
+    return schedule(*this, n, {});
+  }
+
+  async_load dataset_loader::load_data_async(size_t n, std::function<void(std::future<pressio_data>)> then) {
+    return schedule(*this, n, std::move(then));
+  }
+
+  pressio_data dataset_loader::load_region(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) {
+    return copy_region(load_data(n), offset, count);
+  }
 }
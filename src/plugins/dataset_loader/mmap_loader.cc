@@ -0,0 +1,264 @@
+#include <libpressio_dataset_ext/loader.h>
+#include <std_compat/memory.h>
+#include <cleanup.h>
+#include <region.h>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <functional>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace libpressio_dataset { namespace mmap_loader_ns {
+
+  /**
+   * a mapping of the first len bytes of a file
+   */
+  struct mapping {
+    mapping(std::string const& path, size_t len, bool writable, int advice, bool huge_pages): len(len) {
+      if(len == 0) return;
+      int fd = open(path.c_str(), O_RDONLY);
+      if(fd < 0) {
+        throw std::runtime_error("failed to open " + path);
+      }
+      auto cleanup_fd = make_cleanup([fd]{ close(fd); });
+      //private mappings let callers modify the data without changing the file
+      ptr = mmap(nullptr, len, writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+      if(ptr == MAP_FAILED) {
+        ptr = nullptr;
+        throw std::runtime_error("failed to map " + path);
+      }
+      //advice only affects performance, so failures are ignored
+      madvise(ptr, len, advice);
+#ifdef MADV_HUGEPAGE
+      if(huge_pages) madvise(ptr, len, MADV_HUGEPAGE);
+#else
+      (void)huge_pages;
+#endif
+    }
+    mapping(mapping const&)=delete;
+    mapping& operator=(mapping const&)=delete;
+    ~mapping() {
+      if(ptr) munmap(ptr, len);
+    }
+
+    void* ptr = nullptr;
+    size_t len;
+  };
+
+  /**
+   * read-only mappings kept between calls, shared by clones
+   */
+  struct mapping_cache {
+    std::shared_ptr<const mapping> find(std::string const& path) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if(it->first == path) {
+          entries.splice(entries.begin(), entries, it);
+          return entries.front().second;
+        }
+      }
+      return nullptr;
+    }
+    void insert(std::string const& path, std::shared_ptr<const mapping> const& map, size_t capacity) {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto const& entry : entries) {
+        if(entry.first == path) return;
+      }
+      //callers may still hold evicted mappings, which are unmapped once released
+      while(!entries.empty() && entries.size() >= capacity) {
+        entries.pop_back();
+      }
+      entries.emplace_front(path, map);
+    }
+    std::mutex mutex;
+    std::list<std::pair<std::string, std::shared_ptr<const mapping>>> entries;
+  };
+
+  void unmap_fn(void*, void* metadata) {
+    delete static_cast<mapping*>(metadata);
+  }
+  void release_fn(void*, void* metadata) {
+    delete static_cast<std::shared_ptr<const mapping>*>(metadata);
+  }
+
+  struct mmap_loader: public dataset_loader_base {
+
+    size_t num_datasets_impl() override {
+      struct stat s;
+      return (stat(path.c_str(), &s) == 0) ? 1 : 0;
+    }
+
+    int set_options_impl(pressio_options const& options) override {
+      get(options, "io:path", &path);
+      pressio_data tmp_dims;
+      if(get(options, "mmap:dims", &tmp_dims) == pressio_options_key_set) {
+        dims = tmp_dims.to_vector<size_t>();
+      }
+      get(options, "mmap:dtype", &dtype);
+      std::string new_advice = advice;
+      if(get(options, "mmap:advice", &new_advice) == pressio_options_key_set) {
+        if(advice_flag(new_advice) < 0) {
+          return set_error(1, "unsupported mmap:advice " + new_advice);
+        }
+        advice = std::move(new_advice);
+      }
+      get(options, "mmap:huge_pages", &huge_pages);
+      uint64_t new_keep_mapped = keep_mapped;
+      if(get(options, "mmap:keep_mapped", &new_keep_mapped) == pressio_options_key_set && new_keep_mapped != keep_mapped) {
+        keep_mapped = new_keep_mapped;
+        kept = std::make_shared<mapping_cache>();
+      }
+      return 0;
+    }
+
+    pressio_options get_options_impl() const override {
+      pressio_options options;
+      set(options, "io:path", path);
+      set(options, "mmap:dims", pressio_data(dims.begin(), dims.end()));
+      set(options, "mmap:dtype", dtype);
+      set(options, "mmap:advice", advice);
+      set(options, "mmap:huge_pages", huge_pages);
+      set(options, "mmap:keep_mapped", keep_mapped);
+      return options;
+    }
+
+    pressio_options get_documentation_impl() const override {
+      pressio_options options;
+      set(options, "io:path", "path to the raw file to map");
+      set(options, "mmap:dims", "dimensions of the file; if empty, the file is one dimensional");
+      set(options, "mmap:dtype", "type of the elements of the file");
+      set(options, "mmap:advice", "expected access pattern passed to madvise: normal, sequential, random, or willneed");
+      set(options, "mmap:huge_pages", "ask the kernel to back the mapping with huge pages where it supports it");
+      set(options, "mmap:keep_mapped", "number of files to keep mapped between calls; kept mappings are shared read-only "
+          "between the returned data, so it must not be modified.  If 0, each load maps a private writable copy");
+      return options;
+    }
+
+    /**
+     * \returns a view of the file; pages are read as they are first touched
+     */
+    pressio_data load_data_impl(size_t) override {
+      const std::vector<size_t> file_dims = get_dims();
+      const size_t bytes = size_in_bytes(file_dims);
+      if(bytes == 0) return pressio_data::owning(dtype, file_dims);
+      if(keep_mapped) {
+        auto map = kept_mapping();
+        return pressio_data::move(dtype, map->ptr, file_dims, release_fn, new std::shared_ptr<const mapping>(map));
+      }
+      auto map = compat::make_unique<mapping>(path, bytes, true, advice_flag(advice), huge_pages);
+      void* ptr = map->ptr;
+      return pressio_data::move(dtype, ptr, file_dims, unmap_fn, map.release());
+    }
+
+    bool supports_region_impl() override {
+      return true;
+    }
+
+    /**
+     * copies the region out of a mapping, so only the pages containing it are read
+     */
+    pressio_data load_region_impl(size_t, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      const std::vector<size_t> file_dims = get_dims();
+      check_region(file_dims, offset, count);
+      pressio_data ret = pressio_data::owning(dtype, count);
+      if(ret.num_elements() == 0) return ret;
+      std::shared_ptr<const mapping> map;
+      if(keep_mapped) {
+        map = kept_mapping();
+      } else {
+        map = std::make_shared<const mapping>(path, size_in_bytes(file_dims), false, advice_flag(advice), huge_pages);
+      }
+      const size_t elem = pressio_dtype_size(dtype);
+      auto src = static_cast<const unsigned char*>(map->ptr);
+      auto dst = static_cast<unsigned char*>(ret.data());
+      for_each_region_run(file_dims, offset, count, [&](size_t src_elem, size_t dst_elem, size_t n) {
+          std::memcpy(dst + dst_elem*elem, src + src_elem*elem, n*elem);
+      });
+      return ret;
+    }
+
+    pressio_options load_metadata_impl(size_t) override {
+      pressio_options metadata;
+      const std::vector<size_t> file_dims = get_dims();
+      set(metadata, "loader:dims", pressio_data(file_dims.begin(), file_dims.end()));
+      set(metadata, "loader:dtype", dtype);
+      return metadata;
+    }
+
+    std::unique_ptr<dataset_loader> clone() override {
+      return std::make_unique<mmap_loader>(*this);
+    }
+
+    const char* prefix() const override {
+      return "mmap";
+    }
+    const char* version() const override{
+      static std::string s = [this]{
+        std::stringstream ss;
+        ss << this->major_version() << '.';
+        ss << this->minor_version() << '.';
+        ss << this->patch_version();
+        return ss.str();
+      }();
+      return s.c_str();
+    }
+
+    private:
+    static int advice_flag(std::string const& name) {
+      if(name == "normal") return MADV_NORMAL;
+      if(name == "sequential") return MADV_SEQUENTIAL;
+      if(name == "random") return MADV_RANDOM;
+      if(name == "willneed") return MADV_WILLNEED;
+      return -1;
+    }
+
+    size_t file_size() const {
+      struct stat s;
+      if(stat(path.c_str(), &s) != 0) {
+        throw std::runtime_error("failed to stat " + path);
+      }
+      return s.st_size;
+    }
+
+    size_t size_in_bytes(std::vector<size_t> const& file_dims) const {
+      return std::accumulate(file_dims.begin(), file_dims.end(), pressio_dtype_size(dtype), std::multiplies<>{});
+    }
+
+    /**
+     * \returns mmap:dims, or the number of whole elements in the file if it is not set
+     */
+    std::vector<size_t> get_dims() const {
+      const size_t size = file_size();
+      if(dims.empty()) {
+        return {size / pressio_dtype_size(dtype)};
+      }
+      if(size_in_bytes(dims) > size) {
+        throw std::runtime_error("mmap:dims exceed the size of " + path);
+      }
+      return dims;
+    }
+
+    std::shared_ptr<const mapping> kept_mapping() {
+      if(auto map = kept->find(path)) return map;
+      auto map = std::make_shared<const mapping>(path, file_size(), false, advice_flag(advice), huge_pages);
+      kept->insert(path, map, keep_mapped);
+      return map;
+    }
+
+    std::string path;
+    std::vector<size_t> dims;
+    pressio_dtype dtype = pressio_float_dtype;
+    std::string advice = "normal";
+    bool huge_pages = false;
+    uint64_t keep_mapped = 0;
+    std::shared_ptr<mapping_cache> kept = std::make_shared<mapping_cache>();
+  };
+
+  pressio_register mmap_loader_register(dataset_loader_plugins(), "mmap", []{ return compat::make_unique<mmap_loader>(); });
+}}
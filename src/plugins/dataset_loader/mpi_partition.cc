@@ -0,0 +1,410 @@
+#include <libpressio_dataset_ext/loader.h>
+#include <std_compat/memory.h>
+#include <lazy.h>
+#include <disk_cache.h>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <mpi.h>
+
+namespace libpressio_dataset { namespace mpi_partition_loader_ns {
+
+  /**
+   * a counter on rank 0 of a communicator that ranks advance with MPI_Fetch_and_op
+   *
+   * creating and destroying the counter are collective over the communicator
+   */
+  struct shared_counter {
+    explicit shared_counter(MPI_Comm comm): comm(comm) {
+      int rank;
+      MPI_Comm_rank(comm, &rank);
+      MPI_Win_allocate((rank == 0) ? sizeof(uint64_t) : 0, sizeof(uint64_t), MPI_INFO_NULL, comm, &base, &win);
+      MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+      if(rank == 0) {
+        *base = 0;
+        MPI_Win_sync(win);
+      }
+      MPI_Barrier(comm);
+    }
+    shared_counter(shared_counter const&)=delete;
+    shared_counter& operator=(shared_counter const&)=delete;
+    ~shared_counter() {
+      int finalized = 0;
+      MPI_Finalized(&finalized);
+      if(finalized) return;
+      MPI_Win_unlock_all(win);
+      MPI_Win_free(&win);
+    }
+
+    /**
+     * \returns the value of the counter before adding n to it
+     */
+    uint64_t fetch_add(uint64_t n) {
+      uint64_t previous = 0;
+      MPI_Fetch_and_op(&n, &previous, MPI_UINT64_T, 0, 0, MPI_SUM, win);
+      MPI_Win_flush(0, win);
+      return previous;
+    }
+
+    MPI_Comm comm;
+    uint64_t* base = nullptr;
+    MPI_Win win = MPI_WIN_NULL;
+  };
+
+  /**
+   * the child indices claimed by this rank in dynamic mode, shared by clones
+   *
+   * indices only grows, so a position refers to the same dataset for the life of the claims
+   */
+  struct claims {
+    std::mutex mutex;
+    std::unique_ptr<shared_counter> counter;
+    std::vector<size_t> indices;
+    bool exhausted = false;
+  };
+
+  struct mpi_partition_loader: public dataset_loader_base {
+
+    /**
+     * in dynamic mode, the number of datasets claimed so far; it only changes when mpi_partition:claim is set
+     */
+    size_t num_datasets_impl() override {
+      if(mode == "dynamic") {
+        std::lock_guard<std::mutex> lock(dynamic->mutex);
+        counter();
+        return dynamic->indices.size();
+      }
+      return partition().size();
+    }
+
+    int set_options_impl(pressio_options const& options) override {
+      const uint64_t old_hash = configuration_hash(loader_id, loader->get_options());
+      get_meta(options, "mpi_partition:loader", dataset_loader_plugins(), loader_id, loader);
+      //the assignment and the collective counter are only rebuilt when what they divide changes
+      bool changed = configuration_hash(loader_id, loader->get_options()) != old_hash;
+      void* new_comm = comm;
+      if(get(options, "mpi_partition:comm", &new_comm) == pressio_options_key_set && new_comm != comm) {
+        comm = new_comm;
+        changed = true;
+      }
+      std::string new_mode = mode;
+      if(get(options, "mpi_partition:mode", &new_mode) == pressio_options_key_set && new_mode != mode) {
+        if(new_mode != "block" && new_mode != "cyclic" && new_mode != "balanced" && new_mode != "dynamic") {
+          return set_error(1, "unsupported mpi_partition:mode " + new_mode);
+        }
+        mode = std::move(new_mode);
+        changed = true;
+      }
+      uint64_t new_chunk = chunk;
+      if(get(options, "mpi_partition:chunk", &new_chunk) == pressio_options_key_set) {
+        if(new_chunk == 0) {
+          return set_error(1, "mpi_partition:chunk must be at least 1");
+        }
+        chunk = new_chunk;
+      }
+      if(changed) {
+        assigned.reset();
+        dynamic = std::make_shared<claims>();
+      }
+      bool tmp;
+      if(get(options, "mpi_partition:claim", &tmp) == pressio_options_key_set) {
+        if(mode != "dynamic") {
+          return set_error(1, "mpi_partition:claim requires mpi_partition:mode dynamic");
+        }
+        std::lock_guard<std::mutex> lock(dynamic->mutex);
+        claim();
+      }
+      return 0;
+    }
+
+    pressio_options get_options_impl() const override {
+      pressio_options options;
+      set_meta(options, "mpi_partition:loader", loader_id, loader);
+      set(options, "mpi_partition:comm", comm);
+      set(options, "mpi_partition:mode", mode);
+      set(options, "mpi_partition:chunk", chunk);
+      set_type(options, "mpi_partition:claim", pressio_option_bool_type);
+      {
+        std::lock_guard<std::mutex> lock(dynamic->mutex);
+        set(options, "mpi_partition:exhausted", dynamic->exhausted);
+      }
+      int initialized = 0;
+      MPI_Initialized(&initialized);
+      if(initialized) {
+        int rank, size;
+        MPI_Comm_rank(get_comm(), &rank);
+        MPI_Comm_size(get_comm(), &size);
+        set(options, "mpi_partition:rank", static_cast<uint64_t>(rank));
+        set(options, "mpi_partition:size", static_cast<uint64_t>(size));
+      }
+      return options;
+    }
+
+    pressio_options get_documentation_impl() const override {
+      pressio_options options;
+      set_meta_docs(options, "mpi_partition:loader", "loader whose datasets are divided between the ranks", loader);
+      set(options, "mpi_partition:comm", "pointer to the MPI_Comm to divide the datasets over; if null, MPI_COMM_WORLD.  "
+          "Every rank must configure the loader the same way and make its first call to num_datasets after each "
+          "configuration, because balanced and dynamic modes communicate then");
+      set(options, "mpi_partition:mode", "how datasets are assigned to ranks: block gives each rank a contiguous range, "
+          "cyclic deals them out in turn, balanced gives the largest remaining dataset (by loader:dims and loader:dtype) "
+          "to the rank with the fewest bytes, and dynamic lets ranks claim mpi_partition:chunk datasets at a time "
+          "from a counter on rank 0 as they finish their work.  In dynamic mode num_datasets is the number claimed so far: "
+          "load_all_data and load_all_metadata claim and load until every dataset is taken, and other consumers "
+          "set mpi_partition:claim to take more, after which the new datasets follow the ones claimed before");
+      set(options, "mpi_partition:chunk", "number of datasets claimed at once in dynamic mode");
+      set(options, "mpi_partition:claim", "in dynamic mode, claim the next mpi_partition:chunk datasets for this rank");
+      set(options, "mpi_partition:exhausted", "in dynamic mode, true once every dataset has been claimed by some rank");
+      set(options, "mpi_partition:rank", "the rank of this process in the communicator");
+      set(options, "mpi_partition:size", "the number of ranks in the communicator");
+      return options;
+    }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
+
+    pressio_data load_data_impl(size_t n) override {
+      return loader->load_data(child_index(n));
+    }
+
+    pressio_options load_metadata_impl(size_t n) override {
+      const size_t index = child_index(n);
+      pressio_options metadata = loader->load_metadata(index);
+      pressio_dtype dtype = pressio_byte_dtype;
+      pressio_data dims;
+      if(metadata.get(loader->get_name(), "loader:dims", &dims) == pressio_options_key_set) {
+        set(metadata, "loader:dims", dims);
+      }
+      if(metadata.get(loader->get_name(), "loader:dtype", &dtype) == pressio_options_key_set) {
+        set(metadata, "loader:dtype", dtype);
+      }
+      set(metadata, "mpi_partition:index", static_cast<uint64_t>(index));
+      return metadata;
+    }
+
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      std::vector<size_t> children;
+      children.reserve(indices.size());
+      for (auto i : indices) {
+        children.emplace_back(child_index(i));
+      }
+      return loader->load_data_batch(children);
+    }
+
+    /**
+     * in dynamic mode, alternate between loading what this rank has claimed and claiming more
+     * until every dataset is taken, so faster ranks load more
+     */
+    std::vector<pressio_data> load_all_data() override {
+      if(mode != "dynamic") return dataset_loader::load_all_data();
+      return drain([](dataset_loader& self, std::vector<size_t> const& positions){ return self.load_data_batch(positions); });
+    }
+
+    std::vector<pressio_options> load_all_metadata() override {
+      if(mode != "dynamic") return dataset_loader::load_all_metadata();
+      return drain([](dataset_loader& self, std::vector<size_t> const& positions){ return self.load_metadata_batch(positions); });
+    }
+
+    bool supports_region_impl() override {
+      return loader->supports_region();
+    }
+
+    pressio_data load_region_impl(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      return loader->load_region(child_index(n), offset, count);
+    }
+
+    void set_name_impl(std::string const& new_name) override {
+      loader->set_name(new_name + "/" + loader->prefix());
+    }
+
+    std::unique_ptr<dataset_loader> clone() override {
+      return std::make_unique<mpi_partition_loader>(*this);
+    }
+
+    const char* prefix() const override {
+      return "mpi_partition";
+    }
+    const char* version() const override{
+      static std::string s = [this]{
+        std::stringstream ss;
+        ss << this->major_version() << '.';
+        ss << this->minor_version() << '.';
+        ss << this->patch_version();
+        return ss.str();
+      }();
+      return s.c_str();
+    }
+
+    private:
+
+    MPI_Comm get_comm() const {
+      return comm ? *static_cast<MPI_Comm*>(comm) : MPI_COMM_WORLD;
+    }
+
+    static void require_mpi() {
+      int initialized = 0;
+      MPI_Initialized(&initialized);
+      if(!initialized) {
+        throw std::runtime_error("mpi_partition requires MPI to be initialized");
+      }
+    }
+
+    /**
+     * \returns the child index of this rank's n-th dataset
+     */
+    size_t child_index(size_t n) {
+      if(mode == "dynamic") {
+        std::lock_guard<std::mutex> lock(dynamic->mutex);
+        return dynamic->indices.at(n);
+      }
+      return partition().at(n);
+    }
+
+    /**
+     * load every position claimed so far with load, then claim more until the counter is exhausted
+     *
+     * \returns the results for every position this rank has claimed, in order
+     */
+    template <class Load>
+    auto drain(Load&& load) -> decltype(load(std::declval<dataset_loader&>(), std::vector<size_t>{})) {
+      //through the public interface so the loads are counted in this loader's metrics
+      dataset_loader& self = *this;
+      decltype(load(self, std::vector<size_t>{})) ret;
+      while(true) {
+        const size_t claimed = self.num_datasets();
+        std::vector<size_t> positions(claimed - ret.size());
+        std::iota(positions.begin(), positions.end(), ret.size());
+        auto loaded = load(self, positions);
+        std::move(loaded.begin(), loaded.end(), std::back_inserter(ret));
+        std::lock_guard<std::mutex> lock(dynamic->mutex);
+        if(dynamic->exhausted) break;
+        claim();
+      }
+      return ret;
+    }
+
+    /**
+     * the child indices assigned to this rank by a static mode, in increasing order
+     *
+     * every rank computes the whole assignment, so the first call is collective in balanced mode
+     */
+    std::vector<size_t> const& partition() {
+      return assigned.get([this]{
+          trace::span span("scan", "mpi_partition:scan");
+          require_mpi();
+          MPI_Comm comm = get_comm();
+          int rank_i, size_i;
+          MPI_Comm_rank(comm, &rank_i);
+          MPI_Comm_size(comm, &size_i);
+          const size_t rank = rank_i, size = size_i;
+          const size_t N = loader->num_datasets();
+          std::vector<size_t> mine;
+          if(mode == "block") {
+            //the first N % size ranks take one extra
+            const size_t begin = rank * (N / size) + std::min(rank, N % size);
+            const size_t end = begin + N / size + (rank < N % size ? 1 : 0);
+            mine.resize(end - begin);
+            std::iota(mine.begin(), mine.end(), begin);
+          } else if(mode == "cyclic") {
+            for (size_t i = rank; i < N; i += size) {
+              mine.emplace_back(i);
+            }
+          } else {
+            const std::vector<uint64_t> bytes = dataset_bytes(comm, rank, size, N);
+            std::vector<size_t> order(N);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&bytes](size_t lhs, size_t rhs) {
+                return bytes[lhs] > bytes[rhs];
+            });
+            //longest processing time first; ties go to the lowest rank so every rank agrees
+            using load = std::pair<uint64_t, size_t>;
+            std::priority_queue<load, std::vector<load>, std::greater<load>> ranks;
+            for (size_t r = 0; r < size; ++r) {
+              ranks.emplace(0, r);
+            }
+            for (auto i : order) {
+              load least = ranks.top();
+              ranks.pop();
+              if(least.second == rank) mine.emplace_back(i);
+              least.first += bytes[i];
+              ranks.push(least);
+            }
+            std::sort(mine.begin(), mine.end());
+          }
+          span.arg("datasets", static_cast<uint64_t>(mine.size()));
+          return mine;
+      });
+    }
+
+    /**
+     * \returns the size in bytes of each child dataset; each rank reads the metadata of
+     * every size-th dataset and the results are combined with MPI_Allreduce
+     */
+    std::vector<uint64_t> dataset_bytes(MPI_Comm comm, size_t rank, size_t size, size_t N) {
+      std::vector<size_t> indices;
+      for (size_t i = rank; i < N; i += size) {
+        indices.emplace_back(i);
+      }
+      std::vector<uint64_t> local(N, 0), bytes(N, 0);
+      auto metadata = loader->load_metadata_batch(indices);
+      for (size_t i = 0; i < indices.size(); ++i) {
+        pressio_data dims;
+        pressio_dtype dtype = pressio_byte_dtype;
+        if(metadata[i].get(loader->get_name(), "loader:dims", &dims) != pressio_options_key_set) {
+          continue;
+        }
+        metadata[i].get(loader->get_name(), "loader:dtype", &dtype);
+        const auto dims_v = dims.to_vector<uint64_t>();
+        local[indices[i]] = std::accumulate(dims_v.begin(), dims_v.end(), uint64_t{pressio_dtype_size(dtype)}, std::multiplies<>{});
+      }
+      MPI_Allreduce(local.data(), bytes.data(), static_cast<int>(N), MPI_UINT64_T, MPI_SUM, comm);
+      return bytes;
+    }
+
+    /**
+     * \returns the shared counter, creating it on first use; requires dynamic->mutex
+     *
+     * creating the counter is collective, so every rank's first call to num_datasets
+     * or mpi_partition:claim after a configuration change must match
+     */
+    shared_counter& counter() {
+      if(!dynamic->counter) {
+        require_mpi();
+        dynamic->counter = std::make_unique<shared_counter>(get_comm());
+      }
+      return *dynamic->counter;
+    }
+
+    /**
+     * claim the next chunk of datasets from the shared counter; requires dynamic->mutex
+     */
+    void claim() {
+      trace::span span("mpi", "mpi_partition:claim");
+      if(dynamic->exhausted) return;
+      const size_t N = loader->num_datasets();
+      const uint64_t begin = counter().fetch_add(chunk);
+      const uint64_t end = std::min<uint64_t>(begin + chunk, N);
+      for (uint64_t i = begin; i < end; ++i) {
+        dynamic->indices.emplace_back(i);
+      }
+      if(end >= N) dynamic->exhausted = true;
+      span.arg("first", begin);
+    }
+
+    void* comm = nullptr;
+    std::string mode = "block";
+    uint64_t chunk = 1;
+    lazy<std::vector<size_t>> assigned;
+    std::shared_ptr<claims> dynamic = std::make_shared<claims>();
+    std::string loader_id = "io_loader";
+    pressio_dataset_loader loader = dataset_loader_plugins().build(loader_id);
+  };
+
+  pressio_register mpi_partition_loader_register(dataset_loader_plugins(), "mpi_partition", []{ return compat::make_unique<mpi_partition_loader>(); });
+}}
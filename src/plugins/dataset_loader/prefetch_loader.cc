@@ -0,0 +1,238 @@
+#include <libpressio_dataset_ext/loader.h>
+#include <std_compat/memory.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+namespace libpressio_dataset { namespace prefetch_loader_ns {
+  struct prefetch_loader: public dataset_loader_base {
+    prefetch_loader()=default;
+    prefetch_loader(prefetch_loader const& rhs):
+      dataset_loader_base(rhs),
+      depth(rhs.depth),
+      prefetch_threads(rhs.prefetch_threads),
+      stride(rhs.stride),
+      pattern(rhs.pattern),
+      indices(rhs.indices),
+      loader_id(rhs.loader_id),
+      loader(rhs.loader)
+    {}
+    ~prefetch_loader() {
+      stop();
+    }
+
+    size_t num_datasets_impl() override {
+      return loader->num_datasets();
+    }
+
+    int set_options_impl(pressio_options const& options) override {
+      //any of these options may change what the child loads, so drop outstanding reads first
+      stop();
+      get_meta(options, "prefetch:loader", dataset_loader_plugins(), loader_id, loader);
+      get(options, "prefetch:depth", &depth);
+      get(options, "prefetch:nthreads", &prefetch_threads);
+      get(options, "prefetch:stride", &stride);
+      std::string new_pattern = pattern;
+      if(get(options, "prefetch:pattern", &new_pattern) == pressio_options_key_set) {
+        if(new_pattern != "sequential" && new_pattern != "strided" && new_pattern != "explicit") {
+          return set_error(1, "unsupported prefetch:pattern " + new_pattern);
+        }
+        pattern = std::move(new_pattern);
+      }
+      pressio_data new_indices;
+      if(get(options, "prefetch:indices", &new_indices) == pressio_options_key_set) {
+        indices = new_indices.to_vector<size_t>();
+      }
+      return 0;
+    }
+
+    pressio_options get_options_impl() const override {
+      pressio_options options;
+      set_meta(options, "prefetch:loader", loader_id, loader);
+      set(options, "prefetch:depth", depth);
+      set(options, "prefetch:nthreads", prefetch_threads);
+      set(options, "prefetch:stride", stride);
+      set(options, "prefetch:pattern", pattern);
+      set(options, "prefetch:indices", pressio_data(indices.begin(), indices.end()));
+      return options;
+    }
+
+    pressio_options get_documentation_impl() const override {
+      pressio_options options;
+      set_meta_docs(options, "prefetch:loader", "loader to read ahead from", loader);
+      set(options, "prefetch:depth", "number of datasets to load ahead of the most recent request");
+      set(options, "prefetch:nthreads", "number of worker threads used to load ahead");
+      set(options, "prefetch:stride", "distance between requests when prefetch:pattern is strided");
+      set(options, "prefetch:pattern", "expected access pattern: sequential, strided, or explicit");
+      set(options, "prefetch:indices", "expected order of requests when prefetch:pattern is explicit");
+      return options;
+    }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
+
+    pressio_data load_data_impl(size_t n) override {
+      std::future<pressio_data> pending;
+      {
+        std::lock_guard<std::mutex> lock(inflight_mutex);
+        start();
+        auto it = inflight.find(n);
+        if(it != inflight.end()) {
+          pending = std::move(it->second.result);
+          inflight.erase(it);
+        }
+        schedule(n);
+      }
+      if(pending.valid()) {
+        return pending.get();
+      }
+      return loader->load_data(n);
+    }
+
+    pressio_options load_metadata_impl(size_t n) override {
+      auto metadata = loader->load_metadata(n);
+      //republish what the child reported under this loader's name, and nothing it did not
+      pressio_data dims;
+      pressio_dtype dtype = pressio_byte_dtype;
+      if(metadata.get(loader->get_name(), "loader:dims", &dims) == pressio_options_key_set) {
+        set(metadata, "loader:dims", dims);
+      }
+      if(metadata.get(loader->get_name(), "loader:dtype", &dtype) == pressio_options_key_set) {
+        set(metadata, "loader:dtype", dtype);
+      }
+      return metadata;
+    }
+
+    std::unique_ptr<dataset_loader> clone() override {
+      return std::make_unique<prefetch_loader>(*this);
+    }
+
+    const char* prefix() const override {
+      return "prefetch";
+    }
+    const char* version() const override{
+      static std::string s = [this]{
+        std::stringstream ss;
+        ss << this->major_version() << '.';
+        ss << this->minor_version() << '.';
+        ss << this->patch_version();
+        return ss.str();
+      }();
+      return s.c_str();
+    }
+
+    void set_name_impl(std::string const& new_name) override {
+      stop();
+      loader->set_name(new_name + "/" + loader->prefix());
+    }
+
+    private:
+
+    /**
+     * the indices expected to follow n given the access pattern
+     *
+     * requires inflight_mutex to be held
+     */
+    std::vector<size_t> upcoming(size_t n) {
+      std::vector<size_t> next;
+      const size_t N = num_datasets_cache;
+      if(pattern == "explicit") {
+        auto it = std::find(indices.begin() + std::min(last_position, indices.size()), indices.end(), n);
+        if(it == indices.end()) {
+          it = std::find(indices.begin(), indices.end(), n);
+        }
+        if(it == indices.end()) return next;
+        last_position = std::distance(indices.begin(), it);
+        for (++it; it != indices.end() && next.size() < depth; ++it) {
+          if(*it < N) next.emplace_back(*it);
+        }
+      } else {
+        const size_t step = (pattern == "strided") ? std::max<size_t>(stride, 1) : 1;
+        for (size_t i = 1; i <= depth; ++i) {
+          size_t idx = n + i * step;
+          if(idx >= N) break;
+          next.emplace_back(idx);
+        }
+      }
+      return next;
+    }
+
+    /**
+     * start reads of the indices expected to follow n; requires inflight_mutex to be held
+     */
+    void schedule(size_t n) {
+      std::vector<size_t> next = upcoming(n);
+      //forget reads that fell out of the window so memory stays bounded by depth;
+      //those still queued are skipped instead of read
+      for (auto it = inflight.begin(); it != inflight.end();) {
+        if(std::find(next.begin(), next.end(), it->first) == next.end()) {
+          it->second.cancelled->store(true);
+          it = inflight.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      for (auto idx : next) {
+        if(inflight.find(idx) != inflight.end()) continue;
+        auto cancelled = std::make_shared<std::atomic<bool>>(false);
+        auto result = pool->submit([this, idx, cancelled](size_t worker){
+            if(cancelled->load()) return pressio_data{};
+            return workers[worker]->load_data(idx);
+        });
+        inflight.emplace(idx, pending_read{std::move(result), std::move(cancelled)});
+      }
+    }
+
+    /**
+     * create the workers on first use; requires inflight_mutex to be held
+     */
+    void start() {
+      if(pool) return;
+      //resolve any lazy scans before cloning so the workers don't repeat them
+      num_datasets_cache = loader->num_datasets();
+      workers.clear();
+      for (uint64_t i = 0; i < std::max<uint64_t>(prefetch_threads, 1); ++i) {
+        workers.emplace_back(loader->clone());
+      }
+      last_position = 0;
+      pool = std::make_unique<thread_pool>(workers.size());
+    }
+
+    void stop() {
+      for (auto& read : inflight) {
+        read.second.cancelled->store(true);
+      }
+      pool.reset();
+      inflight.clear();
+      workers.clear();
+    }
+
+    uint64_t depth = 2;
+    uint64_t prefetch_threads = 1;
+    uint64_t stride = 1;
+    std::string pattern = "sequential";
+    std::vector<size_t> indices;
+    std::string loader_id = "io_loader";
+    pressio_dataset_loader loader = dataset_loader_plugins().build(loader_id);
+
+    size_t num_datasets_cache = 0;
+    size_t last_position = 0;
+    std::mutex inflight_mutex;
+    /**
+     * a read started by schedule; cancelled is set once nothing will wait for it
+     */
+    struct pending_read {
+      std::future<pressio_data> result;
+      std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+    std::map<size_t, pending_read> inflight;
+    std::vector<pressio_dataset_loader> workers;
+    std::unique_ptr<thread_pool> pool;
+  };
+
+  pressio_register prefetch_loader_register(dataset_loader_plugins(), "prefetch", []{ return compat::make_unique<prefetch_loader>(); });
+}}
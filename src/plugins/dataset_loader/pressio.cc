@@ -24,11 +24,19 @@ namespace libpressio_dataset { namespace pressio_loader_ns {
       set_meta_docs(options, "pressio:loader", "base loader plugin", loader);
       return options;
     }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
     
     pressio_data load_data_impl(size_t n) override {
       return loader->load_data(n);
     }
 
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      return loader->load_data_batch(indices);
+    }
+
     pressio_options load_metadata_impl(size_t n) override {
         auto metadata = loader->load_metadata(n);
         pressio_data dims;
@@ -1,23 +1,69 @@
 #include <libpressio_dataset_ext/loader.h>
 #include <std_compat/memory.h>
+#include <lazy.h>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <random>
 namespace libpressio_dataset { namespace random_sampler_loader_ns {
 
   struct random_sampler_loader: public dataset_loader_base {
 
-    void scan() {
-      if(!sample) {
-          sample = std::vector<size_t>();
-
+    /**
+     * \returns the child index of each sample, in the order given by random_sampler:order
+     */
+    std::vector<size_t> const& scan() {
+      return sample.get([this]{
+          trace::span span("scan", "random_sampler:scan");
+          std::vector<size_t> picked;
+          const size_t child_datasets = loader->num_datasets();
+          if(child_datasets == 0) {
+            return picked;
+          }
           std::seed_seq seed{this->seed};
           std::mt19937 gen{seed};
-          std::uniform_int_distribution<size_t> dist(0, loader->num_datasets());
-          sample->reserve(N);
+          std::uniform_int_distribution<size_t> dist(0, child_datasets - 1);
+          picked.reserve(N);
           for (uint64_t i = 0; i < N; ++i) {
-              sample->emplace_back(dist(gen));
+              picked.emplace_back(dist(gen));
           }
+          if(order == "index") {
+            std::sort(picked.begin(), picked.end());
+          } else if(order == "offset") {
+            sort_by_offset(picked);
+          }
+          return picked;
+      });
+    }
+
+    /**
+     * sort picked by the loader:offset reported by the child, so samples are
+     * read in the order they are stored.  Datasets without an offset follow in index order
+     */
+    void sort_by_offset(std::vector<size_t>& picked) {
+      std::vector<size_t> distinct = picked;
+      std::sort(distinct.begin(), distinct.end());
+      distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+      auto metadata = loader->load_metadata_batch(distinct);
+      std::map<size_t, uint64_t> offsets;
+      for (size_t i = 0; i < distinct.size(); ++i) {
+        uint64_t offset = 0;
+        if(metadata[i].get(loader->get_name(), "loader:offset", &offset) == pressio_options_key_set) {
+          offsets[distinct[i]] = offset;
+        }
       }
+      std::stable_sort(picked.begin(), picked.end(), [&offsets](size_t lhs, size_t rhs) {
+          auto l = offsets.find(lhs), r = offsets.find(rhs);
+          if(l != offsets.end() && r != offsets.end()) {
+            return (l->second == r->second) ? lhs < rhs : l->second < r->second;
+          }
+          if(l != offsets.end() || r != offsets.end()) {
+            return l != offsets.end();
+          }
+          return lhs < rhs;
+      });
     }
 
     size_t num_datasets_impl() override {
@@ -30,6 +76,17 @@ namespace libpressio_dataset { namespace random_sampler_loader_ns {
       get_meta(options, "random_sampler:loader", dataset_loader_plugins(), loader_id, loader);
       get(options, "random_sampler:n", &N);
       get(options, "random_sampler:seed", &seed);
+      std::string new_order = order;
+      if(get(options, "random_sampler:order", &new_order) == pressio_options_key_set) {
+        if(new_order != "random" && new_order != "index" && new_order != "offset") {
+          return set_error(1, "unsupported random_sampler:order " + new_order);
+        }
+        order = std::move(new_order);
+      }
+      get(options, "random_sampler:dedup", &dedup);
+      get(options, "random_sampler:dedup_entries", &dedup_entries);
+      sample.reset();
+      recent = std::make_shared<recent_loads>();
       return 0;
     }
 
@@ -38,6 +95,9 @@ namespace libpressio_dataset { namespace random_sampler_loader_ns {
       set_meta(options, "random_sampler:loader", loader_id, loader);
       set(options, "random_sampler:n", N);
       set(options, "random_sampler:seed", seed);
+      set(options, "random_sampler:order", order);
+      set(options, "random_sampler:dedup", dedup);
+      set(options, "random_sampler:dedup_entries", dedup_entries);
       return options;
     }
 
@@ -46,17 +106,46 @@ namespace libpressio_dataset { namespace random_sampler_loader_ns {
       set_meta_docs(options, "random_sampler:loader", "loader to sample from", loader);
       set(options, "random_sampler:n", "number of samples to take from the data source");
       set(options, "random_sampler:seed", "seed");
+      set(options, "random_sampler:order", "order of the samples: random keeps the order they were drawn in, "
+          "index sorts them by the index in the data source, and offset sorts them by where the data source "
+          "stores them (its loader:offset metadata) so they are read sequentially");
+      set(options, "random_sampler:dedup", "load a dataset drawn more than once only once per batch, "
+          "and for single loads reuse any of the random_sampler:dedup_entries datasets loaded most recently");
+      set(options, "random_sampler:dedup_entries", "number of recently loaded datasets kept for reuse by single loads when random_sampler:dedup is set; "
+          "with order index or offset repeated draws are adjacent, so 1 covers every repeat");
       return options;
     }
+
+    pressio_options get_metrics_results_impl() const override {
+      return loader->get_metrics_results();
+    }
     
     pressio_data load_data_impl(size_t n) override {
-      scan();
-      return loader->load_data(sample->at(n));
+      const size_t index = scan().at(n);
+      if(!dedup) {
+        return loader->load_data(index);
+      }
+      {
+        std::lock_guard<std::mutex> lock(recent->mutex);
+        auto it = recent->find(index);
+        if(it != recent->entries.end()) {
+          recent->entries.splice(recent->entries.begin(), recent->entries, it);
+          return it->second;
+        }
+      }
+      pressio_data data = loader->load_data(index);
+      std::lock_guard<std::mutex> lock(recent->mutex);
+      if(dedup_entries != 0 && recent->find(index) == recent->entries.end()) {
+        recent->entries.emplace_front(index, data);
+        while(recent->entries.size() > dedup_entries) {
+          recent->entries.pop_back();
+        }
+      }
+      return data;
     }
 
     pressio_options load_metadata_impl(size_t n) override {
-      scan();
-      pressio_options metadata = loader->load_metadata(sample->at(n));
+      pressio_options metadata = loader->load_metadata(scan().at(n));
       pressio_dtype dtype;
       pressio_data dims;
       metadata.get(loader->get_name(), "loader:dims", &dims);
@@ -67,12 +156,49 @@ namespace libpressio_dataset { namespace random_sampler_loader_ns {
       return metadata;
     }
 
+    std::vector<pressio_data> load_data_batch_impl(std::vector<size_t> const& indices) override {
+      std::vector<size_t> const& picked = scan();
+      std::vector<size_t> sampled;
+      sampled.reserve(indices.size());
+      for (auto i : indices) {
+        sampled.emplace_back(picked.at(i));
+      }
+      if(!dedup) {
+        return loader->load_data_batch(sampled);
+      }
+
+      std::vector<size_t> distinct = sampled;
+      std::sort(distinct.begin(), distinct.end());
+      distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+      if(distinct.size() == sampled.size()) {
+        return loader->load_data_batch(sampled);
+      }
+      std::vector<pressio_data> loaded = loader->load_data_batch(distinct);
+      std::vector<pressio_data> ret;
+      ret.reserve(sampled.size());
+      for (auto i : sampled) {
+        auto it = std::lower_bound(distinct.begin(), distinct.end(), i);
+        ret.emplace_back(loaded[it - distinct.begin()]);
+      }
+      return ret;
+    }
+
+    bool supports_region_impl() override {
+      return loader->supports_region();
+    }
+
+    pressio_data load_region_impl(size_t n, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      return loader->load_region(scan().at(n), offset, count);
+    }
+
     void set_name_impl(std::string const& new_name) override {
       loader->set_name(new_name + "/" + loader->prefix());
     }
 
     std::unique_ptr<dataset_loader> clone() override {
-      return std::make_unique<random_sampler_loader>(*this);
+      auto ret = std::make_unique<random_sampler_loader>(*this);
+      ret->recent = std::make_shared<recent_loads>();
+      return ret;
     }
 
     const char* prefix() const override {
@@ -89,9 +215,24 @@ namespace libpressio_dataset { namespace random_sampler_loader_ns {
       return s.c_str();
     }
 
+    /**
+     * the datasets most recently loaded by load_data, most recent first; clones keep their own
+     */
+    struct recent_loads {
+      std::list<std::pair<size_t, pressio_data>>::iterator find(size_t index) {
+        return std::find_if(entries.begin(), entries.end(), [index](auto const& entry){ return entry.first == index; });
+      }
+      std::mutex mutex;
+      std::list<std::pair<size_t, pressio_data>> entries;
+    };
+
     uint64_t seed = 0;
     uint64_t N = 1;
-    compat::optional<std::vector<size_t>> sample;
+    std::string order = "random";
+    bool dedup = false;
+    uint64_t dedup_entries = 4;
+    lazy<std::vector<size_t>> sample;
+    std::shared_ptr<recent_loads> recent = std::make_shared<recent_loads>();
     std::string loader_id = "io_loader";
     pressio_dataset_loader loader = dataset_loader_plugins().build(loader_id);
   };
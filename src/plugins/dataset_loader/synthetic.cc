@@ -0,0 +1,411 @@
+#include <libpressio_dataset_ext/loader.h>
+#include <libpressio_dataset_ext/trace.h>
+#include <std_compat/memory.h>
+#include <region.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace libpressio_dataset { namespace synthetic_loader_ns {
+
+  /**
+   * the splitmix64 finalizer; a bijection on 64 bit integers with good avalanche
+   */
+  inline uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  constexpr uint64_t golden = 0x9e3779b97f4a7c15ull;
+  constexpr double two_pi = 6.283185307179586;
+
+  /**
+   * the i-th random number of the stream identified by key
+   *
+   * this is counter based: every element is a function of only its position, so
+   * any region can be generated on any number of threads with the same result
+   */
+  inline uint64_t random(uint64_t key, uint64_t i) {
+    return mix(key + i * golden);
+  }
+
+  /**
+   * \returns a uniform value in [0,1)
+   */
+  inline double uniform(uint64_t h) {
+    return static_cast<double>(h >> 11) * 0x1.0p-53;
+  }
+
+  /**
+   * \returns a standard normal value using the Box-Muller transform of the two halves of h
+   */
+  inline double normal(uint64_t h) {
+    const double u1 = static_cast<double>((h >> 32) + 1) * 0x1.0p-32;
+    const double u2 = static_cast<double>(h & 0xffffffffull) * 0x1.0p-32;
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(two_pi * u2);
+  }
+
+  /**
+   * \returns the standard normal values for elements 2i and 2i+1 of the stream identified by key
+   *
+   * the Box-Muller transform makes two values at once, so each pair of elements
+   * shares one random number, log, and sqrt
+   */
+  inline std::pair<double, double> normal_pair(uint64_t key, uint64_t i) {
+    const uint64_t h = random(key, i);
+    const double u1 = static_cast<double>((h >> 32) + 1) * 0x1.0p-32;
+    const double u2 = static_cast<double>(h & 0xffffffffull) * 0x1.0p-32;
+    const double r = std::sqrt(-2.0 * std::log(u1));
+    return {r * std::cos(two_pi * u2), r * std::sin(two_pi * u2)};
+  }
+
+  enum class field_kind {
+    gaussian,
+    sinusoid,
+    turbulence,
+    constant,
+    sparse,
+  };
+
+  bool parse_field(std::string const& name, field_kind& kind) {
+    if(name == "gaussian") kind = field_kind::gaussian;
+    else if(name == "sinusoid") kind = field_kind::sinusoid;
+    else if(name == "turbulence") kind = field_kind::turbulence;
+    else if(name == "constant") kind = field_kind::constant;
+    else if(name == "sparse") kind = field_kind::sparse;
+    else return false;
+    return true;
+  }
+
+  /**
+   * the sum of separable waves, amplitude[m] * prod_d sin(2 pi k[m][d] x_d / dims_d + phase[m][d]),
+   * sampled at the coordinates of one region
+   */
+  struct wave_plan {
+    std::vector<double> amplitude;
+    /** waves[m][d][i] is the factor of wave m along dimension d at offset[d]+i */
+    std::vector<std::vector<std::vector<double>>> waves;
+  };
+
+  struct synthetic_loader: public dataset_loader_base {
+
+    size_t num_datasets_impl() override {
+      return n;
+    }
+
+    int set_options_impl(pressio_options const& options) override {
+      pressio_data tmp_dims;
+      if(get(options, "synthetic:dims", &tmp_dims) == pressio_options_key_set) {
+        dims = tmp_dims.to_vector<size_t>();
+      }
+      pressio_dtype new_dtype = dtype;
+      if(get(options, "synthetic:dtype", &new_dtype) == pressio_options_key_set) {
+        if(new_dtype != pressio_float_dtype && new_dtype != pressio_double_dtype) {
+          return set_error(1, "synthetic:dtype must be float or double");
+        }
+        dtype = new_dtype;
+      }
+      std::string new_field_name;
+      if(get(options, "synthetic:field", &new_field_name) == pressio_options_key_set) {
+        if(!parse_field(new_field_name, field)) {
+          return set_error(1, "unsupported synthetic:field " + new_field_name);
+        }
+        field_name = std::move(new_field_name);
+      }
+      double new_density = density;
+      if(get(options, "synthetic:density", &new_density) == pressio_options_key_set) {
+        if(!(new_density >= 0 && new_density <= 1)) {
+          return set_error(1, "synthetic:density must be in [0,1]");
+        }
+        density = new_density;
+      }
+      get(options, "synthetic:n", &n);
+      get(options, "synthetic:seed", &seed);
+      get(options, "synthetic:value", &value);
+      get(options, "synthetic:amplitude", &amplitude);
+      get(options, "synthetic:modes", &modes);
+      get(options, "synthetic:nthreads", &generate_threads);
+      return 0;
+    }
+
+    pressio_options get_options_impl() const override {
+      pressio_options options;
+      set(options, "synthetic:dims", pressio_data(dims.begin(), dims.end()));
+      set(options, "synthetic:dtype", dtype);
+      set(options, "synthetic:n", n);
+      set(options, "synthetic:seed", seed);
+      set(options, "synthetic:field", field_name);
+      set(options, "synthetic:value", value);
+      set(options, "synthetic:amplitude", amplitude);
+      set(options, "synthetic:density", density);
+      set(options, "synthetic:modes", modes);
+      set(options, "synthetic:nthreads", generate_threads);
+      return options;
+    }
+
+    pressio_options get_documentation_impl() const override {
+      pressio_options options;
+      set(options, "synthetic:dims", "dimensions of each dataset; the last dimension is the fastest varying");
+      set(options, "synthetic:dtype", "type of the elements, float or double");
+      set(options, "synthetic:n", "number of datasets");
+      set(options, "synthetic:seed", "seed for the fields; each dataset and element is a function of only the seed and its position");
+      set(options, "synthetic:field", "kind of field: gaussian (independent normal values), sinusoid (a smooth low frequency wave), "
+          "turbulence (waves whose energy spectrum falls off as k^(-5/3)), constant, or sparse (gaussian values at a fraction of the elements)");
+      set(options, "synthetic:value", "the mean of the field; constant fields and the unset elements of sparse fields take this value");
+      set(options, "synthetic:amplitude", "the standard deviation of gaussian and sparse values, the peak of sinusoids, and the RMS of turbulence");
+      set(options, "synthetic:density", "the fraction of elements of sparse fields that are set");
+      set(options, "synthetic:modes", "number of waves summed for turbulence");
+      set(options, "synthetic:nthreads", "number of threads used to generate each dataset");
+      return options;
+    }
+
+    pressio_data load_data_impl(size_t i) override {
+      return generate(i, std::vector<size_t>(dims.size(), 0), dims);
+    }
+
+    bool supports_region_impl() override {
+      return true;
+    }
+
+    /**
+     * generates only the region, so regions of datasets too large to hold in memory can be loaded
+     */
+    pressio_data load_region_impl(size_t i, std::vector<size_t> const& offset, std::vector<size_t> const& count) override {
+      check_region(dims, offset, count);
+      return generate(i, offset, count);
+    }
+
+    pressio_options load_metadata_impl(size_t) override {
+      pressio_options metadata;
+      set(metadata, "loader:dims", pressio_data(dims.begin(), dims.end()));
+      set(metadata, "loader:dtype", dtype);
+      set(metadata, "synthetic:field", field_name);
+      return metadata;
+    }
+
+    std::unique_ptr<dataset_loader> clone() override {
+      return std::make_unique<synthetic_loader>(*this);
+    }
+
+    const char* prefix() const override {
+      return "synthetic";
+    }
+    const char* version() const override{
+      static std::string s = [this]{
+        std::stringstream ss;
+        ss << this->major_version() << '.';
+        ss << this->minor_version() << '.';
+        ss << this->patch_version();
+        return ss.str();
+      }();
+      return s.c_str();
+    }
+
+    private:
+
+    uint64_t dataset_key(size_t i) const {
+      return mix(seed ^ mix(static_cast<uint64_t>(i) + golden));
+    }
+
+    /**
+     * choose the waves of dataset i and tabulate them at the coordinates of the region
+     */
+    wave_plan plan_waves(uint64_t key, std::vector<size_t> const& offset, std::vector<size_t> const& count) const {
+      wave_plan plan;
+      const size_t ndims = dims.size();
+      const bool turbulence = (field == field_kind::turbulence);
+      const size_t n_waves = turbulence ? std::max<uint64_t>(modes, 1) : 1;
+      const uint64_t wave_key = mix(key ^ 0x5851f42d4c957f2dull);
+      double energy = 0;
+      size_t r = 0;
+      for (size_t m = 0; m < n_waves; ++m) {
+        std::vector<std::vector<double>> factors(ndims);
+        double k2 = 0;
+        for (size_t d = 0; d < ndims; ++d) {
+          //integer wavenumbers keep the field periodic over the dataset
+          const uint64_t k_max = turbulence ? std::max<size_t>(dims[d] / 4, 1) : 3;
+          const double k = static_cast<double>(1 + random(wave_key, r++) % k_max);
+          const double phase = two_pi * uniform(random(wave_key, r++));
+          k2 += k * k;
+          factors[d].resize(count[d]);
+          const double scale = two_pi * k / static_cast<double>(dims[d]);
+          for (size_t c = 0; c < count[d]; ++c) {
+            factors[d][c] = std::sin(scale * static_cast<double>(offset[d] + c) + phase);
+          }
+        }
+        //wavenumbers are drawn uniformly from a box, so there are ~k^(ndims-1) waves
+        //near |k|; scaling each by k^-(5/3 + ndims - 1)/2 gives E(k) ~ k^(-5/3)
+        const double a = turbulence ? std::pow(k2, -(5.0 / 3.0 + static_cast<double>(ndims) - 1.0) / 4.0) : 1.0;
+        energy += a * a * std::pow(0.5, static_cast<double>(ndims));
+        plan.amplitude.push_back(a);
+        plan.waves.emplace_back(std::move(factors));
+      }
+      const double norm = (turbulence && energy > 0) ? amplitude / std::sqrt(energy) : amplitude;
+      for (auto& a : plan.amplitude) a *= norm;
+      return plan;
+    }
+
+    /**
+     * fill one row of the region along the last dimension
+     *
+     * \param[out] out the row
+     * \param[in] len the length of the row
+     * \param[in] first the position in the whole dataset of the first element of the row
+     * \param[in] outer the position of the row within the region in the other dimensions
+     * \param[in] sum scratch space for len values
+     */
+    template <class T>
+    void fill_row(T* out, size_t len, uint64_t key, uint64_t first, wave_plan const& plan,
+        std::vector<size_t> const& outer, std::vector<double>& sum) const {
+      switch(field) {
+        case field_kind::constant:
+          std::fill(out, out + len, static_cast<T>(value));
+          break;
+        case field_kind::gaussian:
+          {
+            //element g is the (g%2)-th value of pair g/2
+            size_t j = 0;
+            if(len != 0 && (first & 1)) {
+              out[j++] = static_cast<T>(value + amplitude * normal_pair(key, first / 2).second);
+            }
+            for (; j + 1 < len; j += 2) {
+              const auto pair = normal_pair(key, (first + j) / 2);
+              out[j] = static_cast<T>(value + amplitude * pair.first);
+              out[j + 1] = static_cast<T>(value + amplitude * pair.second);
+            }
+            if(j < len) {
+              out[j] = static_cast<T>(value + amplitude * normal_pair(key, (first + j) / 2).first);
+            }
+          }
+          break;
+        case field_kind::sparse:
+          {
+            const uint64_t value_key = mix(key ^ 0x2545f4914f6cdd1dull);
+            for (size_t j = 0; j < len; ++j) {
+              const bool is_set = uniform(random(key, first + j)) < density;
+              out[j] = static_cast<T>(is_set ? value + amplitude * normal(random(value_key, first + j)) : value);
+            }
+          }
+          break;
+        case field_kind::sinusoid:
+        case field_kind::turbulence:
+          {
+            const size_t last = dims.size() - 1;
+            std::fill(sum.begin(), sum.begin() + len, value);
+            for (size_t m = 0; m < plan.amplitude.size(); ++m) {
+              double w = plan.amplitude[m];
+              for (size_t d = 0; d < last; ++d) {
+                w *= plan.waves[m][d][outer[d]];
+              }
+              const double* wave = plan.waves[m][last].data();
+              for (size_t j = 0; j < len; ++j) {
+                sum[j] += w * wave[j];
+              }
+            }
+            for (size_t j = 0; j < len; ++j) {
+              out[j] = static_cast<T>(sum[j]);
+            }
+          }
+          break;
+      }
+    }
+
+    template <class T>
+    void fill(T* out, uint64_t key, std::vector<size_t> const& offset, std::vector<size_t> const& count) const {
+      const size_t ndims = dims.size();
+      const size_t last = ndims - 1;
+      const size_t len = count[last];
+      const size_t rows = std::accumulate(count.begin(), count.end() - 1, size_t{1}, std::multiplies<>{});
+      std::vector<uint64_t> strides(ndims, 1);
+      for (size_t d = last; d > 0; --d) {
+        strides[d-1] = strides[d] * dims[d];
+      }
+      wave_plan plan;
+      if(field == field_kind::sinusoid || field == field_kind::turbulence) {
+        plan = plan_waves(key, offset, count);
+      }
+
+      //each thread takes blocks of about 64k elements; rows fill disjoint parts of out
+      const size_t rows_per_block = std::max<size_t>(1, (size_t{1} << 16) / std::max<size_t>(len, 1));
+      const size_t blocks = (rows + rows_per_block - 1) / rows_per_block;
+      std::atomic<size_t> next{0};
+      std::atomic<bool> failed{false};
+      std::mutex error_mutex;
+      std::exception_ptr error;
+      auto work = [&]{
+        try {
+          std::vector<size_t> outer(last);
+          std::vector<double> sum(len);
+          for (size_t b = next++; b < blocks && !failed; b = next++) {
+            const size_t end = std::min(rows, (b + 1) * rows_per_block);
+            for (size_t row = b * rows_per_block; row < end; ++row) {
+              uint64_t first = offset[last];
+              size_t rest = row;
+              for (size_t d = last; d-- > 0;) {
+                outer[d] = rest % count[d];
+                rest /= count[d];
+                first += (offset[d] + outer[d]) * strides[d];
+              }
+              fill_row(out + row * len, len, key, first, plan, outer, sum);
+            }
+          }
+        } catch(...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if(!error) error = std::current_exception();
+          failed = true;
+        }
+      };
+      std::vector<std::thread> threads;
+      for (size_t t = 1; t < std::min<size_t>(generate_threads, blocks); ++t) {
+        threads.emplace_back(work);
+      }
+      work();
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      if(error) std::rethrow_exception(error);
+    }
+
+    pressio_data generate(size_t i, std::vector<size_t> const& offset, std::vector<size_t> const& count) const {
+      if(i >= n) {
+        throw std::out_of_range("synthetic dataset " + std::to_string(i) + " does not exist");
+      }
+      pressio_data ret = pressio_data::owning(dtype, count);
+      if(count.empty() || ret.num_elements() == 0) return ret;
+      trace::span span("synthetic", "generate");
+      if(span) {
+        span.arg("index", static_cast<uint64_t>(i));
+        span.arg("field", field_name);
+      }
+      const uint64_t key = dataset_key(i);
+      if(dtype == pressio_double_dtype) {
+        fill(static_cast<double*>(ret.data()), key, offset, count);
+      } else {
+        fill(static_cast<float*>(ret.data()), key, offset, count);
+      }
+      return ret;
+    }
+
+    std::vector<size_t> dims{64, 64};
+    pressio_dtype dtype = pressio_float_dtype;
+    uint64_t n = 1;
+    uint64_t seed = 0;
+    std::string field_name = "gaussian";
+    field_kind field = field_kind::gaussian;
+    double value = 0;
+    double amplitude = 1;
+    double density = 0.01;
+    uint64_t modes = 16;
+    uint64_t generate_threads = 1;
+  };
+
+  pressio_register synthetic_loader_register(dataset_loader_plugins(), "synthetic", []{ return compat::make_unique<synthetic_loader>(); });
+}}
@@ -0,0 +1,139 @@
+#ifndef LIBPRESSIO_DATASET_REGION_H_J2NC7WQX
+#define LIBPRESSIO_DATASET_REGION_H_J2NC7WQX
+#include <libpressio_ext/cpp/data.h>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+namespace libpressio_dataset {
+
+/**
+ * throws if the region described by offset and count does not fit within dims
+ */
+inline void check_region(std::vector<size_t> const& dims, std::vector<size_t> const& offset, std::vector<size_t> const& count) {
+  if(offset.size() != dims.size() || count.size() != dims.size()) {
+    throw std::runtime_error("region must have the same number of dimensions as the data");
+  }
+  for (size_t i = 0; i < dims.size(); ++i) {
+    if(offset[i] > dims[i] || count[i] > dims[i] - offset[i]) {
+      throw std::runtime_error("region exceeds the bounds of the data");
+    }
+  }
+}
+
+/**
+ * visits the contiguous runs of a region of a C-ordered (last dimension fastest) array
+ *
+ * adjacent trailing dimensions that are read in full are merged into a single run,
+ * so that reading a slab of whole rows is one call to f.
+ *
+ * \param[in] dims the dimensions of the array
+ * \param[in] offset the first element of the region in each dimension
+ * \param[in] count the number of elements of the region in each dimension
+ * \param[in] f called as f(src_element, dst_element, n_elements) for each run
+ */
+template <class Function>
+void for_each_region_run(std::vector<size_t> const& dims, std::vector<size_t> const& offset, std::vector<size_t> const& count, Function&& f) {
+  const size_t ndims = dims.size();
+  if(ndims == 0) return;
+  for (auto c : count) {
+    if(c == 0) return;
+  }
+
+  //find the outermost dimension that is part of the contiguous run
+  size_t run_dim = ndims - 1;
+  size_t run = count[run_dim];
+  while(run_dim > 0 && count[run_dim] == dims[run_dim]) {
+    --run_dim;
+    run *= count[run_dim];
+  }
+
+  std::vector<size_t> src_strides(ndims, 1);
+  for (size_t i = ndims - 1; i > 0; --i) {
+    src_strides[i-1] = src_strides[i] * dims[i];
+  }
+
+  //iterate over every position of the dimensions outside of the run
+  std::vector<size_t> position(run_dim, 0);
+  size_t dst = 0;
+  while(true) {
+    size_t src = offset[run_dim] * src_strides[run_dim];
+    for (size_t i = 0; i < run_dim; ++i) {
+      src += (offset[i] + position[i]) * src_strides[i];
+    }
+    f(src, dst, run);
+    dst += run;
+
+    size_t i = run_dim;
+    while(i > 0) {
+      --i;
+      if(++position[i] < count[i]) break;
+      position[i] = 0;
+      if(i == 0) return;
+    }
+    if(run_dim == 0) return;
+  }
+}
+
+/**
+ * \returns a copy of a region of src, which is interpreted as a C-ordered (last dimension fastest) array
+ */
+inline pressio_data copy_region(pressio_data const& src, std::vector<size_t> const& offset, std::vector<size_t> const& count) {
+  check_region(src.dimensions(), offset, count);
+  pressio_data dst = pressio_data::owning(src.dtype(), count);
+  const size_t elem = pressio_dtype_size(src.dtype());
+  auto src_ptr = static_cast<const unsigned char*>(src.data());
+  auto dst_ptr = static_cast<unsigned char*>(dst.data());
+  for_each_region_run(src.dimensions(), offset, count, [&](size_t src_elem, size_t dst_elem, size_t n) {
+      std::memcpy(dst_ptr + dst_elem*elem, src_ptr + src_elem*elem, n*elem);
+  });
+  return dst;
+}
+
+/**
+ * copy a box of count elements between two C-ordered (last dimension fastest) arrays
+ *
+ * \param[in] src the source array with dimensions src_dims
+ * \param[in] src_offset the first element of the box within src
+ * \param[in] dst the destination array with dimensions dst_dims
+ * \param[in] dst_offset the first element of the box within dst
+ * \param[in] count the size of the box in each dimension
+ * \param[in] elem the size of each element in bytes
+ */
+inline void copy_box(const void* src, std::vector<size_t> const& src_dims, std::vector<size_t> const& src_offset,
+    void* dst, std::vector<size_t> const& dst_dims, std::vector<size_t> const& dst_offset,
+    std::vector<size_t> const& count, size_t elem) {
+  const size_t ndims = count.size();
+  if(ndims == 0) return;
+  for (auto c : count) {
+    if(c == 0) return;
+  }
+  std::vector<size_t> src_strides(ndims, 1), dst_strides(ndims, 1);
+  for (size_t i = ndims - 1; i > 0; --i) {
+    src_strides[i-1] = src_strides[i] * src_dims[i];
+    dst_strides[i-1] = dst_strides[i] * dst_dims[i];
+  }
+  auto src_ptr = static_cast<const unsigned char*>(src);
+  auto dst_ptr = static_cast<unsigned char*>(dst);
+  const size_t run = count[ndims-1] * elem;
+  std::vector<size_t> position(ndims - 1, 0);
+  while(true) {
+    size_t s = src_offset[ndims-1], d = dst_offset[ndims-1];
+    for (size_t i = 0; i + 1 < ndims; ++i) {
+      s += (src_offset[i] + position[i]) * src_strides[i];
+      d += (dst_offset[i] + position[i]) * dst_strides[i];
+    }
+    std::memcpy(dst_ptr + d*elem, src_ptr + s*elem, run);
+
+    size_t i = ndims - 1;
+    while(i > 0) {
+      --i;
+      if(++position[i] < count[i]) break;
+      position[i] = 0;
+      if(i == 0) return;
+    }
+    if(ndims == 1) return;
+  }
+}
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_REGION_H_J2NC7WQX */
@@ -0,0 +1,98 @@
+#ifndef LIBPRESSIO_DATASET_SPSC_RING_H_K2VN7QXE
+#define LIBPRESSIO_DATASET_SPSC_RING_H_K2VN7QXE
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include <vector>
+namespace libpressio_dataset {
+
+/**
+ * a bounded queue between exactly one producer thread and one consumer thread
+ *
+ * push and pop never take a lock while the ring has room or items.  A side
+ * that has to wait sleeps on a condition variable, and the other side only
+ * takes the lock to wake it when it is known to be waiting.
+ *
+ * close wakes both sides: push then fails, and pop fails once the ring is empty.
+ */
+template <class T>
+class spsc_ring {
+  public:
+    explicit spsc_ring(size_t capacity): slots(capacity == 0 ? 1 : capacity) {}
+    spsc_ring(spsc_ring const&)=delete;
+    spsc_ring& operator=(spsc_ring const&)=delete;
+
+    /**
+     * wait for room and append item
+     *
+     * \returns false without appending if the ring was closed
+     */
+    bool push(T item) {
+      const size_t t = tail.load(std::memory_order_relaxed);
+      wait_until(producer_waiting, [this, t]{ return closed.load() || t - head.load() < slots.size(); });
+      if(closed.load()) return false;
+      slots[t % slots.size()] = std::move(item);
+      tail.store(t + 1);
+      wake(consumer_waiting);
+      return true;
+    }
+
+    /**
+     * wait for an item and remove it
+     *
+     * \returns false if the ring is closed and empty
+     */
+    bool pop(T& item) {
+      const size_t h = head.load(std::memory_order_relaxed);
+      wait_until(consumer_waiting, [this, h]{ return tail.load() != h || closed.load(); });
+      if(tail.load() == h) return false;
+      item = std::move(slots[h % slots.size()]);
+      head.store(h + 1);
+      wake(producer_waiting);
+      return true;
+    }
+
+    /**
+     * stop accepting items; may be called from either side or a third thread
+     */
+    void close() {
+      closed.store(true);
+      std::lock_guard<std::mutex> lock(mutex);
+      cv.notify_all();
+    }
+
+  private:
+    /**
+     * sleep until ready returns true; ready must return true once the ring is closed
+     */
+    template <class Ready>
+    void wait_until(std::atomic<bool>& waiting, Ready&& ready) {
+      if(!ready()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        //the other side checks waiting after publishing, so either it sees the flag or ready sees its update
+        waiting.store(true);
+        cv.wait(lock, ready);
+        waiting.store(false);
+      }
+    }
+
+    void wake(std::atomic<bool>& waiting) {
+      if(waiting.load()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+      }
+    }
+
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<bool> closed{false};
+    std::atomic<bool> producer_waiting{false};
+    std::atomic<bool> consumer_waiting{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_SPSC_RING_H_K2VN7QXE */
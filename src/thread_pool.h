@@ -0,0 +1,91 @@
+#ifndef LIBPRESSIO_DATASET_THREAD_POOL_H_Q8W2MZ4C
+#define LIBPRESSIO_DATASET_THREAD_POOL_H_Q8W2MZ4C
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+namespace libpressio_dataset {
+
+/**
+ * a fixed size pool of worker threads
+ *
+ * tasks are invoked with the id of the worker that runs them so that callers can
+ * keep per-worker state (i.e. a clone of a loader) in a vector indexed by that id.
+ *
+ * destroying the pool discards tasks that have not yet started; their futures
+ * report std::future_errc::broken_promise.
+ */
+class thread_pool {
+  public:
+    explicit thread_pool(size_t nthreads) {
+      if(nthreads == 0) nthreads = 1;
+      workers.reserve(nthreads);
+      for (size_t i = 0; i < nthreads; ++i) {
+        workers.emplace_back([this, i]{ run(i); });
+      }
+    }
+    thread_pool(thread_pool const&)=delete;
+    thread_pool& operator=(thread_pool const&)=delete;
+    ~thread_pool() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        tasks.clear();
+      }
+      cv.notify_all();
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    }
+
+    /**
+     * schedule f(worker_id) to run on the pool
+     *
+     * \returns a future for the result of f
+     */
+    template <class Function>
+    auto submit(Function&& f) -> std::future<std::invoke_result_t<Function, size_t>> {
+      using result_type = std::invoke_result_t<Function, size_t>;
+      auto task = std::make_shared<std::packaged_task<result_type(size_t)>>(std::forward<Function>(f));
+      auto ret = task->get_future();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace_back([task](size_t id){ (*task)(id); });
+      }
+      cv.notify_one();
+      return ret;
+    }
+
+    size_t size() const noexcept {
+      return workers.size();
+    }
+
+  private:
+    void run(size_t id) {
+      while(true) {
+        std::function<void(size_t)> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [this]{ return stopping || !tasks.empty(); });
+          if(stopping) return;
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        task(id);
+      }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void(size_t)>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+}
+#endif /* end of include guard: LIBPRESSIO_DATASET_THREAD_POOL_H_Q8W2MZ4C */
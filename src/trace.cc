@@ -0,0 +1,180 @@
+#include <libpressio_dataset_ext/trace.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace libpressio_dataset { namespace trace {
+
+namespace detail {
+  std::atomic<bool> enabled{false};
+}
+
+namespace {
+  struct event {
+    const char* category;
+    const char* name;
+    char phase;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::duration duration;
+    uint64_t thread;
+    std::string args;
+  };
+
+  /**
+   * the events recorded so far
+   *
+   * it is never destroyed, so loaders that are still working while the process
+   * exits (i.e. on the load_data_async threads) can record safely after the trace is written.
+   */
+  struct recorder {
+    std::mutex mutex;
+    std::string path;
+    std::chrono::steady_clock::time_point epoch;
+    std::vector<event> events;
+    bool registered_exit = false;
+
+    /**
+     * write the events to path; requires mutex to be held
+     */
+    void write() {
+      if(path.empty()) return;
+      std::ofstream out(path);
+      const int pid = getpid();
+      out << "{\"traceEvents\":[";
+      bool first = true;
+      char buf[64];
+      for (auto const& e : events) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"cat\":" << quote(e.category) << ",\"name\":" << quote(e.name) << ",\"ph\":\"" << e.phase << '"';
+        std::snprintf(buf, sizeof(buf), "%.3f", std::chrono::duration<double, std::micro>(e.begin - epoch).count());
+        out << ",\"ts\":" << buf;
+        if(e.phase == 'X') {
+          std::snprintf(buf, sizeof(buf), "%.3f", std::chrono::duration<double, std::micro>(e.duration).count());
+          out << ",\"dur\":" << buf;
+        } else {
+          out << ",\"s\":\"t\"";
+        }
+        out << ",\"pid\":" << pid << ",\"tid\":" << e.thread;
+        if(!e.args.empty()) {
+          out << ",\"args\":{" << e.args << '}';
+        }
+        out << '}';
+      }
+      out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+      events.clear();
+    }
+
+    void add(event&& e) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(!detail::enabled.load(std::memory_order_relaxed)) return;
+      events.emplace_back(std::move(e));
+    }
+  };
+
+  recorder& get_recorder() {
+    static recorder* r = new recorder;
+    return *r;
+  }
+
+  uint64_t thread_id() {
+    static std::atomic<uint64_t> next{1};
+    thread_local const uint64_t id = next++;
+    return id;
+  }
+
+  void write_at_exit() {
+    stop();
+  }
+
+  /**
+   * starts tracing when the library is loaded if LIBPRESSIO_DATASET_TRACE names a file
+   */
+  const bool started_from_environment = []{
+    const char* path = std::getenv("LIBPRESSIO_DATASET_TRACE");
+    if(path && *path) {
+      start(path);
+      return true;
+    }
+    return false;
+  }();
+}
+
+void start(std::string const& new_path) {
+  auto& r = get_recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  if(detail::enabled && r.path == new_path) return;
+  r.write();
+  r.path = new_path;
+  r.epoch = std::chrono::steady_clock::now();
+  if(!r.registered_exit) {
+    std::atexit(write_at_exit);
+    r.registered_exit = true;
+  }
+  detail::enabled = true;
+}
+
+void stop() {
+  auto& r = get_recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  detail::enabled = false;
+  r.write();
+  r.path.clear();
+}
+
+std::string path() {
+  auto& r = get_recorder();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  return r.path;
+}
+
+void instant(const char* category, const char* name, std::string const& args) {
+  if(!enabled()) return;
+  get_recorder().add(event{category, name, 'i', std::chrono::steady_clock::now(), {}, thread_id(), args});
+}
+
+std::string quote(std::string const& value) {
+  std::string ret = "\"";
+  for (char c : value) {
+    switch(c) {
+      case '"': ret += "\\\""; break;
+      case '\\': ret += "\\\\"; break;
+      case '\n': ret += "\\n"; break;
+      case '\t': ret += "\\t"; break;
+      default:
+        if(static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          ret += buf;
+        } else {
+          ret += c;
+        }
+    }
+  }
+  ret += '"';
+  return ret;
+}
+
+void span::end() {
+  if(!active) return;
+  active = false;
+  const auto now = std::chrono::steady_clock::now();
+  get_recorder().add(event{category, name, 'X', begin, now - begin, thread_id(), std::move(args)});
+}
+
+void span::arg(const char* key, std::string const& value) {
+  if(!active) return;
+  if(!args.empty()) args += ',';
+  args += quote(key) + ':' + quote(value);
+}
+
+void span::arg(const char* key, uint64_t value) {
+  if(!active) return;
+  if(!args.empty()) args += ',';
+  args += quote(key) + ':' + std::to_string(value);
+}
+
+}}
@@ -1,9 +1,24 @@
 #include "gtest/gtest.h"
 #include <libpressio_dataset_ext/loader.h>
+#include <libpressio_dataset_ext/cursor.h>
 #include <libpressio_ext/cpp/libpressio.h>
 #include <string>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <numeric>
+#include <algorithm>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#if LIBPRESSIO_DATASET_HAS_MPI
+#include <mpi.h>
+#endif
+#if LIBPRESSIO_DATASET_HAS_HDF5
+#include <hdf5.h>
+#endif
 
 using namespace std::string_literals;
 using namespace libpressio_dataset;
@@ -224,3 +239,1224 @@ TEST(libpressio_dataset, cache) {
     std::chrono::duration_cast<std::chrono::milliseconds>(with_cache_end-with_cache_begin).count() << std::endl;
   */
 }
+
+TEST(libpressio_dataset, prefetch) {
+  auto make_loader = [](std::string const& top) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build(top);
+    loader->set_options({
+        {"prefetch:loader", "folder"s},
+        {"prefetch:depth", uint64_t{3}},
+        {"prefetch:nthreads", uint64_t{2}},
+        {"io_loader:dims", pressio_data{500,500}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+        {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+        {"folder:base_dir", (datadir.string())},
+    });
+    return loader;
+  };
+  pressio_dataset_loader prefetch = make_loader("prefetch");
+  ASSERT_TRUE(prefetch);
+  ASSERT_EQ(prefetch->num_datasets(), 26);
+
+  //prefetched results must match what the wrapped loader returns directly
+  auto options = prefetch->get_options();
+  std::vector<std::string> paths;
+  ASSERT_EQ(options.get("folder:paths", &paths), pressio_options_key_set);
+  pressio_dataset_loader direct = make_loader("folder");
+  direct->set_options({{"folder:paths", paths}});
+  for (size_t i = 0; i < prefetch->num_datasets(); ++i) {
+    ASSERT_EQ(prefetch->load_data(i), direct->load_data(i));
+  }
+
+  prefetch->set_options({
+      {"prefetch:pattern", "explicit"s},
+      {"prefetch:indices", pressio_data{5,3,1}},
+  });
+  ASSERT_EQ(prefetch->load_data(5), direct->load_data(5));
+  ASSERT_EQ(prefetch->load_data(3), direct->load_data(3));
+  ASSERT_EQ(prefetch->load_data(1), direct->load_data(1));
+  ASSERT_EQ(prefetch->load_data(7), direct->load_data(7));
+
+  //the child is asked for the next prefetch:depth datasets before the consumer requests them
+  pressio_dataset_loader ahead = make_loader("prefetch");
+  ahead->set_name("pressio");
+  auto child_calls = [&ahead]{
+    uint64_t calls = 0;
+    ahead->get_metrics_results().get("/pressio/folder:metrics:load_data:calls", &calls);
+    return calls;
+  };
+  ASSERT_EQ(ahead->load_data(0), direct->load_data(0));
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while(child_calls() < 4 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(child_calls(), 4);
+  //1 was read ahead, so requesting it only reads 4 further ahead
+  ASSERT_EQ(ahead->load_data(1), direct->load_data(1));
+  while(child_calls() < 5 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(child_calls(), 5);
+}
+
+TEST(libpressio_dataset, parallel_load_all) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("block_sampler");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"block_sampler:block_size", pressio_data{100,100}},
+      {"block_sampler:n", uint64_t{4}},
+      {"block_sampler:loader", "folder"s},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+      {"folder:base_dir", (datadir.string())},
+  });
+  auto serial = loader->load_all_data();
+  auto serial_metadata = loader->load_all_metadata();
+
+  loader->set_options({{"loader:nthreads", uint64_t{4}}});
+  auto parallel = loader->load_all_data();
+  auto parallel_metadata = loader->load_all_metadata();
+  ASSERT_EQ(serial.size(), 4*26);
+  ASSERT_EQ(serial.size(), parallel.size());
+  ASSERT_EQ(serial_metadata.size(), parallel_metadata.size());
+  for (size_t i = 0; i < serial.size(); ++i) {
+    ASSERT_EQ(serial[i], parallel[i]);
+  }
+}
+
+TEST(libpressio_dataset, load_data_batch) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("block_slicer");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"block_slicer:block_size", pressio_data{100,100}},
+      {"block_slicer:loader", "folder"s},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+      {"folder:base_dir", (datadir.string())},
+  });
+  ASSERT_EQ(loader->num_datasets(), 25*26);
+
+  std::vector<size_t> indices{3, 27, 4, 3, 26, 649};
+  auto batch = loader->load_data_batch(indices);
+  auto metadata = loader->load_metadata_batch(indices);
+  ASSERT_EQ(batch.size(), indices.size());
+  ASSERT_EQ(metadata.size(), indices.size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    ASSERT_EQ(batch[i], loader->load_data(indices[i]));
+  }
+}
+
+TEST(libpressio_dataset, cache_eviction) {
+  for (auto const& policy : {"lru"s, "lfu"s, "arc"s}) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+    ASSERT_TRUE(loader);
+    const uint64_t field_bytes = 500*500*sizeof(float);
+    loader->set_options({
+        {"cache:loader", "folder"s},
+        {"cache:policy", policy},
+        {"cache:max_bytes", 3*field_bytes},
+        {"io_loader:dims", pressio_data{500,500}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+        {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+        {"folder:base_dir", (datadir.string())},
+    });
+    for (size_t i = 0; i < 6; ++i) {
+      loader->load_data(i);
+      loader->load_data(i);
+    }
+    uint64_t hits = 0, misses = 0, evictions = 0, resident_bytes = 0;
+    auto options = loader->get_options();
+    ASSERT_EQ(options.get("cache:hits", &hits), pressio_options_key_set);
+    ASSERT_EQ(options.get("cache:misses", &misses), pressio_options_key_set);
+    ASSERT_EQ(options.get("cache:evictions", &evictions), pressio_options_key_set);
+    ASSERT_EQ(options.get("cache:resident_bytes", &resident_bytes), pressio_options_key_set);
+    EXPECT_EQ(hits, 6) << policy;
+    EXPECT_EQ(misses, 6) << policy;
+    EXPECT_EQ(evictions, 3) << policy;
+    EXPECT_EQ(resident_bytes, 3*field_bytes) << policy;
+  }
+}
+
+TEST(libpressio_dataset, cache_eviction_policy) {
+  //with room for three entries, this order leaves a different set resident under each policy
+  const std::vector<size_t> order{1, 0, 2, 2, 0, 3, 4, 1};
+  const std::map<std::string, std::vector<size_t>> expected_resident{
+    {"lru", {1, 3, 4}},
+    {"lfu", {0, 1, 2}},
+    {"arc", {0, 1, 4}},
+  };
+  for (auto const& expected : expected_resident) {
+    for (uint64_t shards : {1, 16}) {
+      pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+      ASSERT_TRUE(loader);
+      const uint64_t field_bytes = 500*500*sizeof(float);
+      loader->set_options({
+          {"cache:loader", "folder"s},
+          {"cache:policy", expected.first},
+          {"cache:shards", shards},
+          {"cache:max_bytes", 3*field_bytes},
+          {"io_loader:dims", pressio_data{500,500}},
+          {"io_loader:dtype", pressio_float_dtype},
+          {"io_loader:use_template", true},
+          {"io_loader:plugin", "posix"s},
+          {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+          {"folder:base_dir", (datadir.string())},
+      });
+      for (size_t i : order) {
+        loader->load_data(i);
+      }
+      uint64_t hits_before = 0, misses_before = 0, hits = 0, misses = 0;
+      ASSERT_EQ(loader->get_options().get("cache:hits", &hits_before), pressio_options_key_set);
+      ASSERT_EQ(loader->get_options().get("cache:misses", &misses_before), pressio_options_key_set);
+      for (size_t i : expected.second) {
+        loader->load_data(i);
+      }
+      ASSERT_EQ(loader->get_options().get("cache:hits", &hits), pressio_options_key_set);
+      ASSERT_EQ(loader->get_options().get("cache:misses", &misses), pressio_options_key_set);
+      EXPECT_EQ(hits - hits_before, 3) << expected.first << " shards=" << shards;
+      EXPECT_EQ(misses, misses_before) << expected.first << " shards=" << shards;
+    }
+  }
+}
+
+TEST(libpressio_dataset, cache_disk) {
+  fs::path disk_dir = fs::temp_directory_path() / ("libpressio_dataset_cache_disk_" + std::to_string(getpid()));
+  fs::remove_all(disk_dir);
+  auto make_loader = [&]{
+    pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+    loader->set_options({
+        {"cache:loader", "io_loader"s},
+        {"cache:disk_dir", disk_dir.string()},
+        {"io_loader:dims", pressio_data{500,500}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+        {"io:path", (datadir/"s0-CLOUDf48.bin.f32").string()},
+    });
+    return loader;
+  };
+  uint64_t disk_hits = 0, disk_writes = 0;
+
+  pressio_dataset_loader cold = make_loader();
+  pressio_data expected = cold->load_data(0);
+  ASSERT_EQ(cold->get_options().get("cache:disk_writes", &disk_writes), pressio_options_key_set);
+  EXPECT_EQ(disk_writes, 1);
+
+  pressio_dataset_loader warm = make_loader();
+  ASSERT_EQ(warm->load_data(0), expected);
+  ASSERT_EQ(warm->get_options().get("cache:disk_hits", &disk_hits), pressio_options_key_set);
+  EXPECT_EQ(disk_hits, 1);
+
+  //tracing does not change what is loaded, so it must not move the persisted entries
+  const fs::path trace_path = disk_dir.string() + ".json";
+  ASSERT_EQ(warm->set_options({{"loader:trace", trace_path.string()}}), 0);
+  pressio_dataset_loader traced = make_loader();
+  ASSERT_EQ(traced->load_data(0), expected);
+  ASSERT_EQ(traced->get_options().get("cache:disk_hits", &disk_hits), pressio_options_key_set);
+  EXPECT_EQ(disk_hits, 1);
+  traced->set_options({{"loader:trace", ""s}});
+  fs::remove(trace_path);
+
+  fs::remove_all(disk_dir);
+}
+
+TEST(libpressio_dataset, cache_disk_performance_options) {
+  fs::path disk_dir = fs::temp_directory_path() / ("libpressio_dataset_cache_disk_perf_" + std::to_string(getpid()));
+  fs::remove_all(disk_dir);
+  auto make_loader = [&](uint64_t scan_threads){
+    pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+    loader->set_options({
+        {"cache:loader", "folder"s},
+        {"cache:disk_dir", disk_dir.string()},
+        {"io_loader:dims", pressio_data{500,500}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+        {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+        {"folder:base_dir", (datadir.string())},
+        {"folder:groups", std::vector<std::string>{"slice", "field", "timestep"}},
+        {"folder:scan_threads", scan_threads},
+    });
+    return loader;
+  };
+  uint64_t disk_hits = 0, disk_writes = 0;
+
+  pressio_dataset_loader cold = make_loader(1);
+  pressio_data expected = cold->load_data(0);
+  ASSERT_EQ(cold->get_options().get("cache:disk_writes", &disk_writes), pressio_options_key_set);
+  EXPECT_EQ(disk_writes, 1);
+
+  //the scan thread count and the scanned paths do not change what is loaded
+  pressio_dataset_loader warm = make_loader(4);
+  ASSERT_EQ(warm->load_data(0), expected);
+  ASSERT_EQ(warm->get_options().get("cache:disk_hits", &disk_hits), pressio_options_key_set);
+  EXPECT_EQ(disk_hits, 1);
+
+  fs::remove_all(disk_dir);
+}
+
+TEST(libpressio_dataset, cache_concurrent) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"cache:loader", "folder"s},
+      {"cache:shards", uint64_t{4}},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+      {"folder:base_dir", (datadir.string())},
+  });
+  const size_t n_indices = 8, n_threads = 16;
+  std::vector<pressio_data> expected;
+  {
+    pressio_dataset_loader reference = dataset_loader_plugins().build("folder");
+    reference->set_options(loader->get_options());
+    for (size_t i = 0; i < n_indices; ++i) expected.emplace_back(reference->load_data(i));
+  }
+
+  //half of the threads share the loader, the others use clones which share its entries
+  std::vector<pressio_dataset_loader> clones;
+  for (size_t t = 0; t < n_threads/2; ++t) clones.emplace_back(loader->clone());
+  std::atomic<size_t> mismatches{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < n_threads; ++t) {
+    dataset_loader& l = (t % 2) ? *loader : *clones[t/2];
+    threads.emplace_back([&, t]{
+      for (size_t j = 0; j < n_indices; ++j) {
+        const size_t i = (j + t) % n_indices;
+        if(!(l.load_data(i) == expected[i])) ++mismatches;
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(mismatches, 0);
+
+  uint64_t hits = 0, misses = 0, coalesced = 0;
+  auto options = loader->get_options();
+  ASSERT_EQ(options.get("cache:hits", &hits), pressio_options_key_set);
+  ASSERT_EQ(options.get("cache:misses", &misses), pressio_options_key_set);
+  ASSERT_EQ(options.get("cache:coalesced", &coalesced), pressio_options_key_set);
+  EXPECT_EQ(misses, n_indices);
+  EXPECT_EQ(hits + misses + coalesced, n_indices * n_threads);
+}
+
+TEST(libpressio_dataset, block_slicer_parents) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("block_slicer");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"block_slicer:block_size", pressio_data{100,100}},
+      {"block_slicer:loader", "cache"s},
+      {"cache:loader", "folder"s},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+      {"folder:base_dir", (datadir.string())},
+  });
+  for (size_t i = 0; i < 2*25; ++i) {
+    loader->load_data(i);
+  }
+  //the counting cache sits between the slicer and the files, so every parent load reaches it
+  uint64_t hits = 0, misses = 0;
+  auto options = loader->get_options();
+  ASSERT_EQ(options.get("block_slicer/cache", "cache:hits", &hits), pressio_options_key_set);
+  ASSERT_EQ(options.get("block_slicer/cache", "cache:misses", &misses), pressio_options_key_set);
+  EXPECT_EQ(hits + misses, 2);
+}
+
+TEST(libpressio_dataset, load_region) {
+  pressio_options io_options{
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"io:path", (datadir/"s0-CLOUDf48.bin.f32").string()},
+  };
+  pressio_dataset_loader io = dataset_loader_plugins().build("io_loader");
+  io->set_options(io_options);
+  ASSERT_TRUE(io->supports_region());
+  pressio_data full = io->load_data(0);
+  pressio_data region = io->load_region(0, {10, 20}, {30, 40});
+  ASSERT_EQ(region.dimensions(), (std::vector<size_t>{30, 40}));
+  const float* full_ptr = static_cast<const float*>(full.data());
+  const float* region_ptr = static_cast<const float*>(region.data());
+  for (size_t i = 0; i < 30; ++i) {
+    for (size_t j = 0; j < 40; ++j) {
+      ASSERT_EQ(region_ptr[i*40+j], full_ptr[(i+10)*500+(j+20)]);
+    }
+  }
+  EXPECT_THROW(io->load_region(0, {490, 0}, {20, 10}), std::runtime_error);
+
+  //the cache does not support regions, so sampling through it reads whole parents
+  for (auto const& sampler : {"block_sampler"s, "block_slicer"s}) {
+    pressio_dataset_loader pushed_down = dataset_loader_plugins().build(sampler);
+    pushed_down->set_options({{sampler + ":loader", "io_loader"s}, {sampler + ":block_size", pressio_data{50,50}}, {"block_sampler:n", uint64_t{4}}});
+    pushed_down->set_options(io_options);
+    pressio_dataset_loader full_read = dataset_loader_plugins().build(sampler);
+    full_read->set_options({{sampler + ":loader", "cache"s}, {"cache:loader", "io_loader"s}, {sampler + ":block_size", pressio_data{50,50}}, {"block_sampler:n", uint64_t{4}}});
+    full_read->set_options(io_options);
+    ASSERT_EQ(pushed_down->num_datasets(), full_read->num_datasets());
+    for (size_t i = 0; i < pushed_down->num_datasets(); ++i) {
+      ASSERT_EQ(pushed_down->load_data(i), full_read->load_data(i)) << sampler << " " << i;
+    }
+  }
+}
+
+TEST(libpressio_dataset, folder_scan_threads) {
+  auto found_paths = [](uint64_t scan_threads) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("folder");
+    loader->set_options({
+        {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+        {"folder:base_dir", (datadir.parent_path().string())},
+        {"folder:recursive", true},
+        {"folder:scan_threads", scan_threads},
+    });
+    loader->num_datasets();
+    std::vector<std::string> paths;
+    loader->get_options().get("folder:paths", &paths);
+    return paths;
+  };
+  auto serial = found_paths(1);
+  ASSERT_EQ(serial.size(), 26);
+  ASSERT_TRUE(std::is_sorted(serial.begin(), serial.end()));
+  ASSERT_EQ(found_paths(4), serial);
+}
+
+TEST(libpressio_dataset, folder_manifest) {
+  fs::path dir = fs::temp_directory_path() / ("libpressio_dataset_folder_manifest_" + std::to_string(getpid()));
+  fs::remove_all(dir);
+  fs::create_directories(dir/"a");
+  fs::create_directories(dir/"b");
+  auto touch = [](fs::path const& path) {
+    std::vector<float> values(16, 1.0f);
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(float));
+  };
+  touch(dir/"a"/"0.f32");
+  touch(dir/"b"/"1.f32");
+  const fs::path manifest = dir/"manifest";
+  auto make_loader = [&]{
+    pressio_dataset_loader loader = dataset_loader_plugins().build("folder");
+    loader->set_options({
+        {"folder:base_dir", dir.string()},
+        {"folder:regex", ".+\\.f32"s},
+        {"folder:recursive", true},
+        {"folder:manifest", manifest.string()},
+        {"io_loader:dims", pressio_data{4,4}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+    });
+    return loader;
+  };
+  {
+    pressio_dataset_loader cold = make_loader();
+    ASSERT_EQ(cold->num_datasets(), 2);
+    cold->load_metadata(0);
+  }
+  ASSERT_TRUE(fs::exists(manifest));
+  std::ifstream in(manifest);
+  std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  EXPECT_NE(contents.find("M\t"), std::string::npos);
+
+  touch(dir/"b"/"2.f32");
+  pressio_dataset_loader warm = make_loader();
+  ASSERT_EQ(warm->num_datasets(), 3);
+  pressio_data dims;
+  ASSERT_EQ(warm->load_metadata(0).get("loader:dims", &dims), pressio_options_key_set);
+  EXPECT_EQ(dims.to_vector<size_t>(), (std::vector<size_t>{4,4}));
+
+  fs::remove_all(dir);
+}
+
+TEST(libpressio_dataset, concurrent_loads) {
+  const pressio_options folder_options{
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+      {"folder:base_dir", (datadir.string())},
+      {"folder:groups", std::vector<std::string>{"slice", "field", "timestep"}},
+  };
+  const std::vector<std::pair<std::string, pressio_options>> trees {
+    {"folder", {}},
+    {"block_slicer", {{"block_slicer:loader", "folder"s}, {"block_slicer:block_size", pressio_data{100,100}}}},
+    {"block_sampler", {{"block_sampler:loader", "folder"s}, {"block_sampler:block_size", pressio_data{100,100}}, {"block_sampler:n", uint64_t{4}}, {"block_sampler:parents", uint64_t{2}}}},
+    {"random_sampler", {{"random_sampler:loader", "folder"s}, {"random_sampler:n", uint64_t{16}}}},
+    {"cache", {{"cache:loader", "folder"s}}},
+    {"prefetch", {{"prefetch:loader", "folder"s}, {"prefetch:depth", uint64_t{2}}}},
+  };
+  const size_t nthreads = 8;
+  for (auto const& tree : trees) {
+    auto make_loader = [&]{
+      pressio_dataset_loader loader = dataset_loader_plugins().build(tree.first);
+      loader->set_options(tree.second);
+      loader->set_options(folder_options);
+      return loader;
+    };
+    pressio_dataset_loader expected_loader = make_loader();
+    const size_t n = std::min<size_t>(expected_loader->num_datasets(), 32);
+    std::vector<pressio_data> expected;
+    for (size_t i = 0; i < n; ++i) {
+      expected.emplace_back(expected_loader->load_data(i));
+    }
+
+    //nothing is loaded before the threads start, so they race to build the indices too
+    pressio_dataset_loader shared = make_loader();
+    std::atomic<size_t> mismatches{0};
+    std::atomic<size_t> errors{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < nthreads; ++t) {
+      threads.emplace_back([&, t]{
+        try {
+          for (size_t j = 0; j < n; ++j) {
+            const size_t i = (j * (t + 1) + t) % n;
+            if(!(shared->load_data(i) == expected[i])) ++mismatches;
+            pressio_data dims;
+            if(shared->load_metadata(i).get("loader:dims", &dims) != pressio_options_key_set) ++mismatches;
+          }
+        } catch(std::exception const&) {
+          ++errors;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(errors, 0) << tree.first;
+    EXPECT_EQ(mismatches, 0) << tree.first;
+  }
+}
+
+TEST(libpressio_dataset, mmap_loader) {
+  const std::string path = (datadir/"s0-CLOUDf48.bin.f32").string();
+  pressio_dataset_loader io = dataset_loader_plugins().build("io_loader");
+  io->set_options({
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"io:path", path},
+  });
+  pressio_data expected = io->load_data(0);
+
+  for (uint64_t keep_mapped : {uint64_t{0}, uint64_t{2}}) {
+    pressio_dataset_loader mapped = dataset_loader_plugins().build("mmap");
+    ASSERT_TRUE(mapped);
+    ASSERT_EQ(mapped->set_options({
+        {"io:path", path},
+        {"mmap:dims", pressio_data{500,500}},
+        {"mmap:advice", "sequential"s},
+        {"mmap:keep_mapped", keep_mapped},
+    }), 0);
+    ASSERT_EQ(mapped->num_datasets(), 1);
+    ASSERT_EQ(mapped->load_data(0), expected);
+    ASSERT_EQ(mapped->load_data(0), expected);
+    ASSERT_TRUE(mapped->supports_region());
+    ASSERT_EQ(mapped->load_region(0, {10, 20}, {30, 40}), io->load_region(0, {10, 20}, {30, 40}));
+  }
+
+  pressio_dataset_loader flat = dataset_loader_plugins().build("mmap");
+  flat->set_options({{"io:path", path}});
+  pressio_data dims;
+  ASSERT_EQ(flat->load_metadata(0).get("loader:dims", &dims), pressio_options_key_set);
+  EXPECT_EQ(dims.to_vector<size_t>(), (std::vector<size_t>{500*500}));
+  EXPECT_NE(flat->set_options({{"mmap:advice", "backwards"s}}), 0);
+}
+
+TEST(libpressio_dataset, folder_async) {
+  auto make_loader = [](pressio_options const& extra) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("folder");
+    loader->set_options({
+        {"io_loader:dims", pressio_data{500,500}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+        {"folder:regex", "(?:[^/]*/)+s(\\d+)-([A-Z]+)f(\\d+).bin.f32"s},
+        {"folder:base_dir", (datadir.string())},
+    });
+    EXPECT_EQ(loader->set_options(extra), 0);
+    return loader;
+  };
+  pressio_dataset_loader sync = make_loader({});
+  std::vector<pressio_data> expected = sync->load_all_data();
+
+  for (bool direct : {false, true}) {
+    pressio_dataset_loader async = make_loader({
+        {"folder:io_mode", "async"s},
+        {"folder:queue_depth", uint64_t{4}},
+        {"folder:direct", direct},
+    });
+    ASSERT_EQ(async->num_datasets(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(async->load_data(i), expected[i]) << i;
+    }
+    auto batch = async->load_data_batch({3, 1, 3});
+    ASSERT_EQ(batch[0], expected[3]);
+    ASSERT_EQ(batch[1], expected[1]);
+    ASSERT_EQ(batch[2], expected[3]);
+  }
+  pressio_dataset_loader bad = dataset_loader_plugins().build("folder");
+  EXPECT_NE(bad->set_options({{"folder:io_mode", "mmap"s}}), 0);
+
+  //files whose size does not match their dims and dtype, i.e. with a header, are not read raw
+  const fs::path dir = fs::temp_directory_path() / ("libpressio_dataset_folder_async_" + std::to_string(getpid()));
+  fs::create_directories(dir);
+  std::vector<float> values(100);
+  std::iota(values.begin(), values.end(), 0.f);
+  {
+    std::ofstream raw(dir / "a.f32", std::ios::binary);
+    raw.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+    std::ofstream with_header(dir / "b.f32", std::ios::binary);
+    with_header.write("header", 6);
+    with_header.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+  }
+  for (auto const& backend : {"pread"s, "auto"s}) {
+    pressio_dataset_loader sized = dataset_loader_plugins().build("folder");
+    ASSERT_EQ(sized->set_options({
+        {"io_loader:dims", pressio_data{100}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+        {"folder:regex", ".*/a.f32|.*/b.f32"s},
+        {"folder:base_dir", dir.string()},
+        {"folder:io_mode", "async"s},
+        {"folder:async_backend", backend},
+    }), 0);
+    ASSERT_EQ(sized->num_datasets(), 2);
+    std::vector<std::string> paths;
+    ASSERT_EQ(sized->get_options().get("folder:paths", &paths), pressio_options_key_set);
+    const size_t good = (fs::path(paths[0]).filename() == "a.f32") ? 0 : 1;
+    EXPECT_EQ(sized->load_data(good).to_vector<float>(), values) << backend;
+    EXPECT_THROW(sized->load_data(1 - good), std::runtime_error) << backend;
+  }
+  fs::remove_all(dir);
+}
+
+TEST(libpressio_dataset, io_loader_probe) {
+  const auto path = datadir/"s0-CLOUDf48.bin.f32";
+  pressio_dataset_loader loader = dataset_loader_plugins().build("io_loader");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"io_loader:plugin", "posix"s},
+      {"io:path", path.string()},
+  });
+  ASSERT_EQ(loader->num_datasets(), 1);
+
+  pressio_data p_dims;
+  pressio_dtype dtype;
+  auto probed = loader->load_metadata(0);
+  ASSERT_EQ(probed.get("loader:dims", &p_dims), pressio_options_key_set);
+  ASSERT_EQ(probed.get("loader:dtype", &dtype), pressio_options_key_set);
+  EXPECT_EQ(p_dims.to_vector<size_t>(), std::vector<size_t>{static_cast<size_t>(fs::file_size(path))});
+  EXPECT_EQ(dtype, pressio_byte_dtype);
+
+  //the probe must agree with what the io plugin reads
+  loader->set_options({{"io_loader:probe", false}});
+  auto read = loader->load_metadata(0);
+  pressio_data read_dims;
+  ASSERT_EQ(read.get("loader:dims", &read_dims), pressio_options_key_set);
+  EXPECT_EQ(read_dims.to_vector<size_t>(), p_dims.to_vector<size_t>());
+
+  loader->set_options({
+      {"io_loader:probe", true},
+      {"io:path", (datadir/"does-not-exist.f32").string()},
+  });
+  EXPECT_EQ(loader->num_datasets(), 0);
+}
+
+TEST(libpressio_dataset, random_sampler_order) {
+  auto make_sampler = [](std::string const& order, bool dedup) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("random_sampler");
+    EXPECT_TRUE(loader);
+    EXPECT_EQ(loader->set_options({
+        {"random_sampler:loader", "folder"s},
+        {"random_sampler:n", uint64_t{32}},
+        {"random_sampler:seed", uint64_t{7}},
+        {"random_sampler:order", order},
+        {"random_sampler:dedup", dedup},
+        {"folder:base_dir", datadir.string()},
+        {"folder:regex", ".*/(s0-.*log10)\\.bin\\.f32"s},
+        {"folder:groups", std::vector<std::string>{"name"}},
+        {"io_loader:dims", pressio_data{500,500}},
+        {"io_loader:dtype", pressio_float_dtype},
+        {"io_loader:use_template", true},
+        {"io_loader:plugin", "posix"s},
+    }), 0);
+    return loader;
+  };
+  auto drawn = make_sampler("random", false);
+  auto sorted = make_sampler("index", true);
+  ASSERT_EQ(drawn->num_datasets(), 32);
+  ASSERT_EQ(sorted->num_datasets(), 32);
+
+  //sorting keeps the same multiset of draws, and sorted samples are loaded in nondecreasing order
+  std::vector<std::string> drawn_paths, sorted_paths;
+  for (size_t i = 0; i < 32; ++i) {
+    std::string path;
+    ASSERT_EQ(drawn->load_metadata(i).get("folder:group:name", &path), pressio_options_key_set);
+    drawn_paths.emplace_back(path);
+    ASSERT_EQ(sorted->load_metadata(i).get("folder:group:name", &path), pressio_options_key_set);
+    sorted_paths.emplace_back(path);
+  }
+  std::vector<std::string> expected = drawn_paths;
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(sorted_paths, expected);
+  //32 draws from the few log10 files must repeat some
+  EXPECT_NE(std::unique(expected.begin(), expected.end()), expected.end());
+
+  std::vector<size_t> indices(32);
+  std::iota(indices.begin(), indices.end(), 0);
+  auto batch = sorted->load_data_batch(indices);
+  ASSERT_EQ(batch.size(), 32);
+  for (size_t i = 0; i < 32; ++i) {
+    EXPECT_TRUE(batch[i] == sorted->load_data(i));
+  }
+
+  //with room for every distinct draw, single loads in draw order read each child dataset once
+  auto reused = make_sampler("random", true);
+  ASSERT_EQ(reused->set_options({{"random_sampler:dedup_entries", uint64_t{7}}}), 0);
+  reused->set_name("pressio");
+  for (size_t i = 0; i < 32; ++i) {
+    EXPECT_TRUE(reused->load_data(i) == drawn->load_data(i)) << i;
+  }
+  uint64_t child_calls = 0;
+  ASSERT_EQ(reused->get_metrics_results().get("/pressio/folder:metrics:load_data:calls", &child_calls), pressio_options_key_set);
+  EXPECT_EQ(child_calls, std::set<std::string>(drawn_paths.begin(), drawn_paths.end()).size());
+
+  auto offset = make_sampler("offset", false);
+  ASSERT_EQ(offset->num_datasets(), 32);
+  EXPECT_NE(offset->set_options({{"random_sampler:order", "backwards"s}}), 0);
+}
+
+TEST(libpressio_dataset, cursor) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("folder");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"folder:base_dir", datadir.string()},
+      {"folder:regex", ".*log10.*\\.f32"s},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+  });
+  const size_t n = loader->num_datasets();
+  ASSERT_GT(n, 2);
+
+  size_t expected = 0;
+  dataset_cursor cursor(*loader, 2);
+  for (auto& item : cursor) {
+    EXPECT_EQ(item.index, expected);
+    EXPECT_TRUE(item.data == loader->load_data(expected));
+    pressio_data dims;
+    EXPECT_EQ(item.metadata.get("loader:dims", &dims), pressio_options_key_set);
+    ++expected;
+  }
+  EXPECT_EQ(expected, n);
+
+  //errors from the loader are reported after the datasets before them
+  dataset_cursor failing(*loader, {1, n + 10, 0}, 1);
+  cursor_item item;
+  ASSERT_TRUE(failing.next(item));
+  EXPECT_EQ(item.index, 1);
+  EXPECT_ANY_THROW(failing.next(item));
+  EXPECT_FALSE(failing.next(item));
+
+  //destroying a cursor early stops its producer
+  {
+    dataset_cursor early(*loader, 1);
+    ASSERT_TRUE(early.next(item));
+  }
+}
+
+TEST(libpressio_dataset, load_data_async) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("folder");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"folder:base_dir", datadir.string()},
+      {"folder:regex", ".*log10.*\\.f32"s},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+  });
+  ASSERT_GT(loader->num_datasets(), 2);
+  auto expected = loader->load_data(1);
+
+  auto load = loader->load_data_async(1);
+  EXPECT_TRUE(load.get() == expected);
+  EXPECT_FALSE(load.cancel());
+
+  std::promise<pressio_data> from_callback;
+  loader->load_data_async(1, [&from_callback](std::future<pressio_data> result) {
+      from_callback.set_value(result.get());
+  });
+  EXPECT_TRUE(from_callback.get_future().get() == expected);
+
+  EXPECT_THROW(loader->load_data_async(loader->num_datasets() + 10).get(), std::exception);
+
+  //callbacks that wait on release keep every executor thread busy, so the last load can't start until then
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  const size_t n_blockers = std::thread::hardware_concurrency() + 4;
+  std::atomic<size_t> unblocked{0};
+  for (size_t i = 0; i < n_blockers; ++i) {
+    loader->load_data_async(0, [released, &unblocked](std::future<pressio_data>) { released.wait(); ++unblocked; });
+  }
+  std::atomic<bool> cancelled{false};
+  auto last = loader->load_data_async(2, [&cancelled](std::future<pressio_data> result) {
+      try {
+        result.get();
+      } catch(load_cancelled const&) {
+        cancelled = true;
+      }
+  });
+  EXPECT_TRUE(last.cancel());
+  EXPECT_TRUE(cancelled);
+  EXPECT_FALSE(last.cancel());
+  release.set_value();
+  //the loader must outlive the loads
+  while(unblocked < n_blockers) {
+    std::this_thread::yield();
+  }
+}
+
+TEST(libpressio_dataset, metrics) {
+  pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"cache:loader", "block_slicer"s},
+      {"block_slicer:loader", "io_loader"s},
+      {"block_slicer:block_size", pressio_data{100,100}},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"io:path", (datadir/"s0-CLOUDf48.bin.f32").string()},
+  });
+  loader->set_name("pressio");
+  ASSERT_EQ(loader->num_datasets(), 25);
+  for (size_t i = 0; i < 3; ++i) {
+    loader->load_data(0);
+  }
+
+  auto metrics = loader->get_metrics_results();
+  uint64_t calls = 0, errors = 0, bytes = 0, total_ns = 0;
+  ASSERT_EQ(metrics.get("/pressio:metrics:load_data:calls", &calls), pressio_options_key_set);
+  ASSERT_EQ(metrics.get("/pressio:metrics:load_data:errors", &errors), pressio_options_key_set);
+  ASSERT_EQ(metrics.get("/pressio:metrics:load_data:bytes", &bytes), pressio_options_key_set);
+  EXPECT_EQ(calls, 3);
+  EXPECT_EQ(errors, 0);
+  EXPECT_EQ(bytes, 3*100*100*sizeof(float));
+
+  //the cache only asked its child once, and the slicer reads just the block from the file
+  ASSERT_EQ(metrics.get("/pressio/block_slicer:metrics:load_data:calls", &calls), pressio_options_key_set);
+  EXPECT_EQ(calls, 1);
+  ASSERT_EQ(metrics.get("/pressio/block_slicer/io_loader:metrics:load_region:total_ns", &total_ns), pressio_options_key_set);
+  EXPECT_GT(total_ns, 0);
+
+  pressio_data histogram;
+  ASSERT_EQ(metrics.get("/pressio/block_slicer/io_loader:metrics:load_region:histogram", &histogram), pressio_options_key_set);
+  auto counts = histogram.to_vector<uint64_t>();
+  ASSERT_EQ(counts.size(), call_metrics::buckets);
+  ASSERT_EQ(metrics.get("/pressio/block_slicer/io_loader:metrics:load_region:calls", &calls), pressio_options_key_set);
+  EXPECT_EQ(calls, 1);
+  EXPECT_EQ(std::accumulate(counts.begin(), counts.end(), uint64_t{0}), calls);
+
+  pressio_dataset_loader missing = dataset_loader_plugins().build("io_loader");
+  missing->set_options({
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io:path", (datadir/"does-not-exist.f32").string()},
+  });
+  EXPECT_ANY_THROW(missing->load_data(0));
+  ASSERT_EQ(missing->get_metrics_results().get("/io_loader:metrics:load_data:errors", &errors), pressio_options_key_set);
+  EXPECT_EQ(errors, 1);
+}
+
+TEST(libpressio_dataset, trace) {
+  const fs::path trace_path = fs::temp_directory_path() / ("libpressio_dataset_trace_" + std::to_string(getpid()) + ".json");
+  pressio_dataset_loader loader = dataset_loader_plugins().build("cache");
+  ASSERT_TRUE(loader);
+  loader->set_options({
+      {"cache:loader", "io_loader"s},
+      {"io_loader:dims", pressio_data{500,500}},
+      {"io_loader:dtype", pressio_float_dtype},
+      {"io_loader:use_template", true},
+      {"io_loader:plugin", "posix"s},
+      {"io:path", (datadir/"s0-CLOUDf48.bin.f32").string()},
+      {"loader:trace", trace_path.string()},
+  });
+  loader->set_name("pressio");
+  std::string recording;
+  loader->get_options().get("/pressio:loader:trace", &recording);
+  EXPECT_EQ(recording, trace_path.string());
+
+  loader->load_data(0);
+  loader->load_data(0);
+  loader->set_options({{"loader:trace", ""s}});
+
+  std::ifstream in(trace_path);
+  std::string trace((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  fs::remove(trace_path);
+  EXPECT_EQ(trace.rfind("{\"traceEvents\":[", 0), 0);
+  EXPECT_NE(trace.find("\"name\":\"cache:miss\""), std::string::npos);
+  EXPECT_NE(trace.find("\"name\":\"cache:hit\""), std::string::npos);
+  EXPECT_NE(trace.find("\"loader\":\"pressio/io_loader\""), std::string::npos);
+  EXPECT_NE(trace.find("\"ph\":\"X\""), std::string::npos);
+
+  //nothing is recorded once tracing stops
+  loader->load_data(0);
+  EXPECT_FALSE(fs::exists(trace_path));
+}
+
+TEST(libpressio_dataset, synthetic) {
+  auto make_loader = [](pressio_options const& extra) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("synthetic");
+    EXPECT_EQ(loader->set_options({
+        {"synthetic:dims", pressio_data{40, 50, 60}},
+        {"synthetic:n", uint64_t{1} << 40},
+        {"synthetic:seed", uint64_t{7}},
+    }), 0);
+    EXPECT_EQ(loader->set_options(extra), 0);
+    return loader;
+  };
+
+  for (auto const& field : {"gaussian"s, "sinusoid"s, "turbulence"s, "constant"s, "sparse"s}) {
+    for (auto dtype : {pressio_float_dtype, pressio_double_dtype}) {
+      pressio_dataset_loader loader = make_loader({{"synthetic:field", field}, {"synthetic:dtype", dtype}});
+      ASSERT_EQ(loader->num_datasets(), uint64_t{1} << 40);
+      pressio_data full = loader->load_data(12345);
+      ASSERT_EQ(full.dtype(), dtype);
+      ASSERT_EQ(full.dimensions(), (std::vector<size_t>{40, 50, 60}));
+
+      //the fields depend only on the seed and position, not on the threads or region
+      pressio_dataset_loader threaded = make_loader({{"synthetic:field", field}, {"synthetic:dtype", dtype}, {"synthetic:nthreads", uint64_t{4}}});
+      ASSERT_EQ(threaded->load_data(12345), full) << field;
+      ASSERT_TRUE(loader->supports_region());
+      auto region = loader->load_region(12345, {3, 7, 11}, {10, 20, 30});
+      pressio_dataset_loader from_data = dataset_loader_plugins().build("from_data");
+      from_data->set_options({{"from_data:n", uint64_t{1}}, {"from_data:data-0", full}});
+      ASSERT_EQ(region, from_data->load_region(0, {3, 7, 11}, {10, 20, 30})) << field;
+      if(field != "constant") {
+        EXPECT_FALSE(loader->load_data(12346) == full) << field;
+      }
+    }
+  }
+
+  pressio_dataset_loader constant = make_loader({{"synthetic:field", "constant"s}, {"synthetic:value", 3.5}});
+  auto values = constant->load_data(0).to_vector<float>();
+  EXPECT_TRUE(std::all_of(values.begin(), values.end(), [](float v){ return v == 3.5f; }));
+
+  pressio_dataset_loader sparse = make_loader({{"synthetic:field", "sparse"s}, {"synthetic:density", 0.1}});
+  values = sparse->load_data(0).to_vector<float>();
+  const double set = std::count_if(values.begin(), values.end(), [](float v){ return v != 0; });
+  EXPECT_NEAR(set / values.size(), 0.1, 0.01);
+
+  //regions of datasets far too large to generate whole
+  pressio_dataset_loader huge = make_loader({{"synthetic:dims", pressio_data{1u << 20, 1u << 20}}});
+  EXPECT_EQ(huge->load_region(0, {1u << 19, 1u << 19}, {16, 16}).num_elements(), 256);
+
+  pressio_dataset_loader bad = dataset_loader_plugins().build("synthetic");
+  EXPECT_NE(bad->set_options({{"synthetic:field", "fractal"s}}), 0);
+  EXPECT_NE(bad->set_options({{"synthetic:dtype", pressio_int32_dtype}}), 0);
+}
+
+#if LIBPRESSIO_DATASET_HAS_HDF5
+/**
+ * create dataset name in file, creating its groups as needed
+ *
+ * the dataset is chunked if chunks is not empty, and never written if values is empty
+ */
+template <class T>
+void write_hdf5_dataset(hid_t file, std::string const& name, hid_t type, std::vector<hsize_t> const& dims, std::vector<T> const& values, std::vector<hsize_t> const& chunks = {}, bool shuffle = false) {
+  hid_t space = H5Screate_simple(static_cast<int>(dims.size()), dims.data(), nullptr);
+  hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(lcpl, 1);
+  hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  if(!chunks.empty()) H5Pset_chunk(dcpl, static_cast<int>(chunks.size()), chunks.data());
+  if(shuffle) H5Pset_shuffle(dcpl);
+  hid_t dset = H5Dcreate2(file, name.c_str(), type, space, lcpl, dcpl, H5P_DEFAULT);
+  ASSERT_GE(dset, 0) << name;
+  if(!values.empty()) {
+    ASSERT_GE(H5Dwrite(dset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()), 0) << name;
+  }
+  H5Dclose(dset);
+  H5Pclose(dcpl);
+  H5Pclose(lcpl);
+  H5Sclose(space);
+}
+
+TEST(libpressio_dataset, hdf5_datasets) {
+  const fs::path path = fs::temp_directory_path() / ("libpressio_dataset_hdf5_" + std::to_string(getpid()) + ".h5");
+  std::vector<float> temperature(4*6);
+  std::iota(temperature.begin(), temperature.end(), 0.f);
+  std::vector<double> pressure(3*5);
+  std::iota(pressure.begin(), pressure.end(), 100.);
+  std::vector<int32_t> labels(10);
+  std::iota(labels.begin(), labels.end(), -5);
+  {
+    hid_t file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    ASSERT_GE(file, 0);
+    write_hdf5_dataset(file, "fields/temperature", H5T_NATIVE_FLOAT, {4, 6}, temperature);
+    write_hdf5_dataset(file, "fields/pressure", H5T_NATIVE_DOUBLE, {3, 5}, pressure);
+    write_hdf5_dataset(file, "labels", H5T_NATIVE_INT32, {10}, labels);
+    //datasets that are not integers or floating point are skipped
+    hid_t str = H5Tcopy(H5T_C_S1);
+    H5Tset_size(str, 8);
+    write_hdf5_dataset(file, "names", str, {2}, std::vector<char>(16, 'a'));
+    H5Tclose(str);
+    H5Fclose(file);
+  }
+
+  pressio_dataset_loader loader = dataset_loader_plugins().build("hdf5_datasets");
+  ASSERT_TRUE(loader);
+  ASSERT_EQ(loader->set_options({{"io:path", path.string()}}), 0);
+  //datasets are visited in name order
+  ASSERT_EQ(loader->num_datasets(), 3);
+  const std::vector<std::string> names{"fields/pressure", "fields/temperature", "labels"};
+  for (size_t i = 0; i < names.size(); ++i) {
+    std::string name;
+    ASSERT_EQ(loader->load_metadata(i).get("hdf5_datasets:path", &name), pressio_options_key_set);
+    EXPECT_EQ(name, names[i]);
+  }
+
+  pressio_data p_dims;
+  pressio_dtype dtype;
+  auto metadata = loader->load_metadata(1);
+  ASSERT_EQ(metadata.get("loader:dims", &p_dims), pressio_options_key_set);
+  ASSERT_EQ(metadata.get("loader:dtype", &dtype), pressio_options_key_set);
+  EXPECT_EQ(p_dims.to_vector<size_t>(), (std::vector<size_t>{4, 6}));
+  EXPECT_EQ(dtype, pressio_float_dtype);
+
+  pressio_data data = loader->load_data(0);
+  EXPECT_EQ(data.dtype(), pressio_double_dtype);
+  EXPECT_EQ(data.dimensions(), (std::vector<size_t>{3, 5}));
+  EXPECT_EQ(data.to_vector<double>(), pressure);
+  EXPECT_EQ(loader->load_data(1).to_vector<float>(), temperature);
+  EXPECT_EQ(loader->load_data(2).to_vector<int32_t>(), labels);
+
+  //clones open their own handles but load the same contents
+  auto clone = loader->clone();
+  ASSERT_EQ(clone->num_datasets(), 3);
+  EXPECT_EQ(clone->load_data(1).to_vector<float>(), temperature);
+  EXPECT_EQ(loader->load_data(0).to_vector<double>(), pressure);
+
+  //changing the regex renumbers the datasets
+  ASSERT_EQ(loader->set_options({
+      {"hdf5_datasets:regex", "fields/(\\w+)"s},
+      {"hdf5_datasets:groups", std::vector<std::string>{"field"}},
+  }), 0);
+  ASSERT_EQ(loader->num_datasets(), 2);
+  std::string field;
+  ASSERT_EQ(loader->load_metadata(1).get("hdf5_datasets:group:field", &field), pressio_options_key_set);
+  EXPECT_EQ(field, "temperature");
+  EXPECT_EQ(loader->load_data(1).to_vector<float>(), temperature);
+  EXPECT_NE(loader->set_options({{"hdf5_datasets:regex", "("s}}), 0);
+
+  fs::remove(path);
+}
+
+TEST(libpressio_dataset, hdf5_chunks) {
+  const fs::path path = fs::temp_directory_path() / ("libpressio_dataset_hdf5_chunks_" + std::to_string(getpid()) + ".h5");
+  //the dims are not multiples of the chunks so the edge chunks are partial
+  const std::vector<size_t> dims{10, 7};
+  std::vector<float> values(10*7);
+  std::iota(values.begin(), values.end(), 0.f);
+  {
+    hid_t file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    ASSERT_GE(file, 0);
+    write_hdf5_dataset(file, "chunked", H5T_NATIVE_FLOAT, {10, 7}, values, {4, 3});
+    write_hdf5_dataset(file, "contiguous", H5T_NATIVE_FLOAT, {10, 7}, values);
+    write_hdf5_dataset(file, "shuffled", H5T_NATIVE_FLOAT, {10, 7}, values, {4, 3}, true);
+    write_hdf5_dataset(file, "sparse", H5T_NATIVE_FLOAT, {10, 7}, std::vector<float>{}, {4, 3});
+    H5Fclose(file);
+  }
+  auto make_loader = [&](uint64_t decode_threads) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("hdf5_datasets");
+    EXPECT_EQ(loader->set_options({
+        {"io:path", path.string()},
+        {"hdf5_datasets:decode_threads", decode_threads},
+    }), 0);
+    return loader;
+  };
+  auto expected_region = [&](std::vector<size_t> const& offset, std::vector<size_t> const& count) {
+    std::vector<float> expected;
+    for (size_t i = offset[0]; i < offset[0] + count[0]; ++i) {
+      for (size_t j = offset[1]; j < offset[1] + count[1]; ++j) {
+        expected.emplace_back(values[i*dims[1] + j]);
+      }
+    }
+    return expected;
+  };
+
+  pressio_dataset_loader serial = make_loader(1);
+  pressio_dataset_loader threaded = make_loader(4);
+  ASSERT_EQ(serial->num_datasets(), 4);
+  pressio_data chunks;
+  ASSERT_EQ(serial->load_metadata(0).get("loader:chunks", &chunks), pressio_options_key_set);
+  EXPECT_EQ(chunks.to_vector<size_t>(), (std::vector<size_t>{4, 3}));
+  ASSERT_EQ(serial->load_metadata(1).get("loader:chunks", &chunks), pressio_options_key_set);
+  EXPECT_EQ(chunks.num_elements(), 0);
+
+  const std::vector<size_t> offset{3, 2}, count{7, 5};
+  ASSERT_TRUE(serial->supports_region());
+  for (size_t n = 0; n < 3; ++n) {
+    EXPECT_EQ(serial->load_data(n).to_vector<float>(), values) << n;
+    EXPECT_EQ(serial->load_region(n, offset, count).to_vector<float>(), expected_region(offset, count)) << n;
+  }
+  for (size_t n : {0, 2}) {
+    EXPECT_EQ(threaded->load_data(n), serial->load_data(n)) << n;
+    pressio_data region = threaded->load_region(n, offset, count);
+    EXPECT_EQ(region.dimensions(), count) << n;
+    EXPECT_EQ(region.to_vector<float>(), expected_region(offset, count)) << n;
+    //a region inside one edge chunk
+    EXPECT_EQ(threaded->load_region(n, {8, 6}, {2, 1}).to_vector<float>(), expected_region({8, 6}, {2, 1})) << n;
+  }
+
+  //chunks that were never written read as the fill value
+  EXPECT_EQ(threaded->load_data(3), serial->load_data(3));
+  auto sparse = threaded->load_region(3, offset, count).to_vector<float>();
+  EXPECT_TRUE(std::all_of(sparse.begin(), sparse.end(), [](float v){ return v == 0; }));
+
+  //one block per stored chunk, read through load_region
+  pressio_dataset_loader slicer = dataset_loader_plugins().build("block_slicer");
+  ASSERT_EQ(slicer->set_options({
+      {"block_slicer:loader", "hdf5_datasets"s},
+      {"block_slicer:block_size", pressio_data{5, 7}},
+      {"block_slicer:chunked", true},
+      {"io:path", path.string()},
+      {"hdf5_datasets:regex", "chunked"s},
+      {"hdf5_datasets:decode_threads", uint64_t{4}},
+  }), 0);
+  ASSERT_EQ(slicer->num_datasets(), 3*3);
+  for (size_t block = 0; block < 9; ++block) {
+    //the first dimension varies fastest
+    const std::vector<size_t> block_offset{block % 3 * 4, block / 3 * 3};
+    const std::vector<size_t> block_count{std::min<size_t>(4, 10 - block_offset[0]), std::min<size_t>(3, 7 - block_offset[1])};
+    pressio_data dims_meta;
+    ASSERT_EQ(slicer->load_metadata(block).get("loader:dims", &dims_meta), pressio_options_key_set);
+    EXPECT_EQ(dims_meta.to_vector<size_t>(), block_count) << block;
+    pressio_data data = slicer->load_data(block);
+    EXPECT_EQ(data.dimensions(), block_count) << block;
+    EXPECT_EQ(data.to_vector<float>(), expected_region(block_offset, block_count)) << block;
+  }
+  //the chunks are used without replacing the configured block size
+  pressio_data block_size;
+  ASSERT_EQ(slicer->get_options().get("block_slicer:block_size", &block_size), pressio_options_key_set);
+  EXPECT_EQ(block_size.to_vector<size_t>(), (std::vector<size_t>{5, 7}));
+  ASSERT_EQ(slicer->set_options({{"block_slicer:chunked", false}}), 0);
+  ASSERT_EQ(slicer->num_datasets(), 2);
+  EXPECT_EQ(slicer->load_data(1).to_vector<float>(), expected_region({5, 0}, {5, 7}));
+
+  //parents are all divided like the first, so their grids must match
+  ASSERT_EQ(slicer->set_options({
+      {"block_slicer:chunked", true},
+      {"hdf5_datasets:regex", "chunked|contiguous"s},
+  }), 0);
+  ASSERT_EQ(slicer->num_datasets(), 2*3*3);
+  EXPECT_NO_THROW(slicer->load_data(8));
+  EXPECT_THROW(slicer->load_data(9), std::runtime_error);
+  EXPECT_THROW(slicer->load_metadata(9), std::runtime_error);
+
+  fs::remove(path);
+}
+#endif
+
+#if LIBPRESSIO_DATASET_HAS_MPI
+TEST(libpressio_dataset, mpi_partition) {
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  if(!initialized) {
+    MPI_Init(nullptr, nullptr);
+    std::atexit([]{ MPI_Finalize(); });
+  }
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  //datasets of different sizes so balanced mode has something to balance
+  const size_t N = 23;
+  pressio_options options{
+    {"mpi_partition:loader", "from_data"s},
+    {"from_data:n", uint64_t{N}},
+  };
+  for (size_t i = 0; i < N; ++i) {
+    options.set("from_data:data-" + std::to_string(i), pressio_data::owning(pressio_float_dtype, {(i * 7) % N + 1}));
+  }
+
+  for (auto const& mode : {"block"s, "cyclic"s, "balanced"s, "dynamic"s}) {
+    pressio_dataset_loader loader = dataset_loader_plugins().build("mpi_partition");
+    ASSERT_TRUE(loader);
+    ASSERT_EQ(loader->set_options(options), 0);
+    ASSERT_EQ(loader->set_options({{"mpi_partition:mode", mode}, {"mpi_partition:chunk", uint64_t{2}}}), 0);
+
+    //dynamic mode claims and loads until every dataset is taken
+    auto metadata = loader->load_all_metadata();
+    auto data = loader->load_all_data();
+    ASSERT_EQ(metadata.size(), loader->num_datasets()) << mode;
+    ASSERT_EQ(data.size(), loader->num_datasets()) << mode;
+    std::vector<int> counts(N, 0);
+    for (size_t i = 0; i < data.size(); ++i) {
+      uint64_t index = 0;
+      ASSERT_EQ(metadata[i].get("mpi_partition:index", &index), pressio_options_key_set);
+      ASSERT_LT(index, N);
+      EXPECT_EQ(data[i].num_elements(), (index * 7) % N + 1);
+      EXPECT_EQ(loader->load_data(i).num_elements(), data[i].num_elements());
+      ++counts[index];
+    }
+    if(mode == "block" || mode == "cyclic") {
+      EXPECT_EQ(loader->num_datasets(), N / size + (static_cast<size_t>(rank) < N % size ? 1 : 0)) << mode;
+    }
+
+    //every dataset goes to exactly one rank
+    std::vector<int> total(N, 0);
+    MPI_Allreduce(counts.data(), total.data(), static_cast<int>(N), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    EXPECT_TRUE(std::all_of(total.begin(), total.end(), [](int c){ return c == 1; })) << mode;
+  }
+
+  //other consumers claim explicitly; num_datasets only changes when they do
+  pressio_dataset_loader dynamic = dataset_loader_plugins().build("mpi_partition");
+  ASSERT_EQ(dynamic->set_options(options), 0);
+  ASSERT_EQ(dynamic->set_options({{"mpi_partition:mode", "dynamic"s}, {"mpi_partition:chunk", uint64_t{3}}}), 0);
+  ASSERT_EQ(dynamic->num_datasets(), 0);
+  std::vector<int> counts(N, 0);
+  bool exhausted = false;
+  size_t loaded = 0;
+  while(!exhausted) {
+    ASSERT_EQ(dynamic->set_options({{"mpi_partition:claim", true}}), 0);
+    ASSERT_EQ(dynamic->get_options().get("mpi_partition:exhausted", &exhausted), pressio_options_key_set);
+    //reconfiguring anything else keeps the claims, and is not collective
+    ASSERT_EQ(dynamic->set_options({{"loader:nthreads", uint64_t{2}}}), 0);
+    const size_t claimed = dynamic->num_datasets();
+    ASSERT_LE(claimed - loaded, 3);
+    for (; loaded < claimed; ++loaded) {
+      uint64_t index = 0;
+      ASSERT_EQ(dynamic->load_metadata(loaded).get("mpi_partition:index", &index), pressio_options_key_set);
+      ++counts[index];
+    }
+  }
+  std::vector<int> total(N, 0);
+  MPI_Allreduce(counts.data(), total.data(), static_cast<int>(N), MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  EXPECT_TRUE(std::all_of(total.begin(), total.end(), [](int c){ return c == 1; }));
+
+  pressio_dataset_loader bad = dataset_loader_plugins().build("mpi_partition");
+  EXPECT_NE(bad->set_options({{"mpi_partition:mode", "random"s}}), 0);
+  EXPECT_NE(bad->set_options({{"mpi_partition:chunk", uint64_t{0}}}), 0);
+  EXPECT_NE(bad->set_options({{"mpi_partition:claim", true}}), 0);
+}
+#endif